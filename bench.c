@@ -0,0 +1,621 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "data.h"
+#include "export.h"
+#include "history.h"
+#include "query.h"
+#include "roster.h"
+#include "sort.h"
+#include "student.h"
+
+/*
+ * To compile use
+ * gcc -O2 -o bench bench.c spreadsheet.c data.c collate.c sort.c query.c roster.c server.c export.c perf.c history.c -pthread -lm
+ *
+ * To run use
+ * ./bench generate 100k roster.txt
+ * ./bench run roster.txt
+ * ./bench all
+*/
+
+#define LOOKUPS 1000
+#define EDITS 10  // Every edit saves the whole roster
+
+typedef enum { DIST_UNIFORM, DIST_NORMAL, DIST_BIMODAL } Distribution;
+
+typedef struct {
+    size_t count;
+    uint64_t seed;
+    int minNameLength;
+    int maxNameLength;
+    Distribution distribution;
+} GeneratorOptions;
+
+// Everything a benchmark needs; each benchmark reads what it uses
+typedef struct {
+    const char *path;
+    Student *students;
+    size_t count;
+    Student *scratch;   // Working copy for benchmarks that modify students
+    char *fileData;     // Whole file, for parse benchmarks
+    char **lines;
+    size_t numLines;
+    int *lookupIds;
+    SortSpec spec;
+    Query query;
+    FILE *devNull;
+} BenchContext;
+
+typedef void (*BenchFunction)(BenchContext *context);
+
+static const char *columnLabels[] = {
+    NULL, "id", "last_name", "exam", "total",
+    "first_name", "asst1", "asst2", "asst3", "midterm"
+};
+
+static volatile double sink;  // Keeps computed results from being optimized away
+
+/**
+ * Returns the next value of a splitmix64 generator.
+ *
+ * A fixed, self-contained generator keeps generated rosters identical across
+ * platforms and C libraries for the same seed.
+ *
+ * @param state The generator state.
+ * @return The next pseudo-random value.
+ */
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Returns a uniform value in [0, 1).
+ *
+ * @param state The generator state.
+ * @return The value.
+ */
+static double nextUniform(uint64_t *state) {
+    return (double)(nextRandom(state) >> 11) / 9007199254740992.0;
+}
+
+/**
+ * Returns a standard normal value (Box-Muller).
+ *
+ * @param state The generator state.
+ * @return The value.
+ */
+static double nextNormal(uint64_t *state) {
+    double u = nextUniform(state);
+    double v = nextUniform(state);
+    return sqrt(-2.0 * log(u + 1e-300)) * cos(2.0 * M_PI * v);
+}
+
+/**
+ * Draws a grade out of maximum from a distribution.
+ *
+ * Normal grades center on 65% with a 15% spread; bimodal grades are split
+ * between a struggling group around 35% and a strong group around 80%.
+ *
+ * @param state The generator state.
+ * @param distribution The distribution to draw from.
+ * @param maximum The highest possible grade.
+ * @return The grade, between 0 and maximum.
+ */
+static int randomGrade(uint64_t *state, Distribution distribution, int maximum) {
+    double fraction;
+    switch (distribution) {
+        case DIST_NORMAL:
+            fraction = 0.65 + 0.15 * nextNormal(state);
+            break;
+        case DIST_BIMODAL:
+            fraction = nextUniform(state) < 0.3 ? 0.35 + 0.10 * nextNormal(state)
+                                                : 0.80 + 0.08 * nextNormal(state);
+            break;
+        default:
+            return (int)(nextRandom(state) % (uint64_t)(maximum + 1));
+    }
+
+    int grade = (int)lround(fraction * maximum);
+    return grade < 0 ? 0 : (grade > maximum ? maximum : grade);
+}
+
+/**
+ * Fills a buffer with a random capitalized name.
+ *
+ * @param state The generator state.
+ * @param options The name length range.
+ * @param name A buffer of at least maxNameLength + 1 bytes.
+ */
+static void randomName(uint64_t *state, const GeneratorOptions *options, char *name) {
+    int span = options->maxNameLength - options->minNameLength + 1;
+    int length = options->minNameLength + (int)(nextRandom(state) % (uint64_t)span);
+
+    for (int i = 0; i < length; i++) {
+        char letter = (char)('a' + nextRandom(state) % 26);
+        name[i] = i == 0 ? (char)(letter - 'a' + 'A') : letter;
+    }
+    name[length] = '\0';
+}
+
+/**
+ * Writes a synthetic roster in the students.txt format.
+ *
+ * Student IDs are 1..count in shuffled order, so ID sorts do real work.
+ * The same options and seed always produce the same file.
+ *
+ * @param path The file to write.
+ * @param options The roster size, seed, name lengths and grade distribution.
+ * @return 0 on success, -1 if there is an error.
+ */
+static int generateRoster(const char *path, const GeneratorOptions *options) {
+    uint64_t state = options->seed;
+    char lastName[50];
+    char firstName[50];
+
+    int *ids = malloc(options->count * sizeof(int));
+    FILE *file = fopen(path, "w");
+    if (ids == NULL || file == NULL) {
+        perror("Error generating roster");
+        free(ids);
+        if (file != NULL) {
+            fclose(file);
+        }
+        return -1;
+    }
+
+    for (size_t i = 0; i < options->count; i++) {
+        ids[i] = (int)i + 1;
+    }
+    for (size_t i = options->count; i > 1; i--) {
+        size_t j = nextRandom(&state) % i;
+        int swap = ids[i - 1];
+        ids[i - 1] = ids[j];
+        ids[j] = swap;
+    }
+
+    for (size_t i = 0; i < options->count; i++) {
+        randomName(&state, options, lastName);
+        randomName(&state, options, firstName);
+        fprintf(file, "%d|%s|%s|%d|%d|%d|%d|%d\n",
+                ids[i], lastName, firstName,
+                randomGrade(&state, options->distribution, 40),
+                randomGrade(&state, options->distribution, 40),
+                randomGrade(&state, options->distribution, 40),
+                randomGrade(&state, options->distribution, 25),
+                randomGrade(&state, options->distribution, 40));
+    }
+
+    free(ids);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/**
+ * Returns the time on the monotonic clock in seconds.
+ *
+ * @return The current time in seconds.
+ */
+static double monotonicSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static void benchLoad(BenchContext *context) {
+    (void)context;
+    free(readFile());
+}
+
+static void benchParse(BenchContext *context) {
+    for (size_t i = 0; i < context->numLines; i++) {
+        parseLine(context->lines[i], &context->scratch[i]);
+    }
+}
+
+static void benchSort(BenchContext *context) {
+    free(sortOrder(context->students, context->count, &context->spec));
+}
+
+static void benchTotals(BenchContext *context) {
+    double sum = 0;
+    for (size_t i = 0; i < context->count; i++) {
+        float total = calculateTotal(context->students[i]);
+        sum += total + calculateGrade(total);
+    }
+    sink = sum;
+}
+
+static void benchHistogram(BenchContext *context) {
+    printGradeDistribution(context->devNull, context->students, context->count, &context->query);
+}
+
+static void benchQuery(BenchContext *context) {
+    unsigned char *matches = malloc(context->count + 1);
+    if (matches != NULL) {
+        sink = (double)evaluateQuery(&context->query, context->students, context->count, matches);
+        free(matches);
+    }
+}
+
+static void benchTop(BenchContext *context) {
+    size_t indexes[10];
+    sink = (double)topByTotal(context->students, context->count, 10, indexes);
+}
+
+/**
+ * Looks students up by ID with the search the edit menus use.
+ */
+static void benchLookup(BenchContext *context) {
+    long found = 0;
+    for (size_t l = 0; l < LOOKUPS; l++) {
+        found += findStudent(context->students, context->lookupIds[l]);
+    }
+    sink = (double)found;
+}
+
+/**
+ * Restores the edit roster to the original students, outside the timed region.
+ */
+static void restoreRoster(BenchContext *context) {
+    loadRoster();
+    Student *students = reserveRoster(context->count);
+    if (students != NULL) {
+        memcpy(students, context->students, (context->count + 1) * sizeof(Student));
+        saveRoster(students, NULL, 0);
+    }
+}
+
+/**
+ * Finds and updates students the way updateExamGrade does, saving each edit.
+ */
+static void benchUpdate(BenchContext *context) {
+    for (size_t l = 0; l < EDITS; l++) {
+        Student *students = loadRoster();
+        long index = findStudent(students, context->lookupIds[l]);
+        if (index >= 0) {
+            setExamGrade(students, (size_t)index, (int)(l % 41));
+        }
+    }
+}
+
+/**
+ * Finds and removes students the way removeStudent does, saving each edit.
+ */
+static void benchDelete(BenchContext *context) {
+    for (size_t l = 0; l < EDITS; l++) {
+        Student *students = loadRoster();
+        long index = findStudent(students, context->lookupIds[l]);
+        if (index >= 0) {
+            deleteStudentAt(students, (size_t)index);
+        }
+    }
+}
+
+static void benchSave(BenchContext *context) {
+    (void)context;
+    saveRoster(loadRoster(), NULL, 0);
+}
+
+static void benchExport(BenchContext *context) {
+    exportStudents("/dev/null", EXPORT_CSV, context->students, context->count, NULL, NULL);
+}
+
+/**
+ * Runs a benchmark several times and prints its best time as a JSON line.
+ *
+ * The scratch copy of the students is restored before every run, outside
+ * the timed region, so benchmarks that modify it all start from the same data.
+ * prepare, if not NULL, also runs untimed before every run.
+ *
+ * @param context The benchmark context.
+ * @param name The benchmark name.
+ * @param function The benchmark.
+ * @param prepare The setup to run before each run, or NULL.
+ * @param ops The number of operations one run performs.
+ * @param repeat The number of runs.
+ */
+static void measure(BenchContext *context, const char *name, BenchFunction function,
+                    BenchFunction prepare, size_t ops, int repeat) {
+    double best = 0;
+
+    for (int r = 0; r < repeat; r++) {
+        memcpy(context->scratch, context->students, (context->count + 1) * sizeof(Student));
+        if (prepare != NULL) {
+            prepare(context);
+        }
+        double start = monotonicSeconds();
+        function(context);
+        double elapsed = monotonicSeconds() - start;
+        if (r == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    printf("{\"benchmark\":\"%s\",\"students\":%zu,\"ops\":%zu,\"repeat\":%d,"
+           "\"seconds\":%.6f,\"ns_per_op\":%.1f}\n",
+           name, context->count, ops, repeat, best, ops > 0 ? best * 1e9 / (double)ops : 0.0);
+    fflush(stdout);
+}
+
+/**
+ * Reads a whole file and splits it into lines in place.
+ *
+ * @param context The context that receives the file data and lines.
+ * @return 0 on success, -1 if there is an error.
+ */
+static int loadLines(BenchContext *context) {
+    FILE *file = fopen(context->path, "r");
+    if (file == NULL) {
+        perror("Error opening roster");
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    context->fileData = malloc((size_t)size + 1);
+    context->lines = malloc(((size_t)size / 2 + 2) * sizeof(char *));
+    if (context->fileData == NULL || context->lines == NULL
+        || fread(context->fileData, 1, (size_t)size, file) != (size_t)size) {
+        perror("Error reading roster");
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    context->fileData[size] = '\0';
+
+    char *line = context->fileData;
+    while (*line != '\0') {
+        context->lines[context->numLines++] = line;
+        char *newline = strchr(line, '\n');
+        if (newline == NULL) {
+            break;
+        }
+        *newline = '\0';
+        line = newline + 1;
+    }
+    return 0;
+}
+
+/**
+ * Times every hot path of the spreadsheet against one roster file.
+ *
+ * Results go to stdout as one JSON object per line.
+ *
+ * @param path The roster file.
+ * @param repeat The number of runs per benchmark; the best is reported.
+ * @return 0 on success, 1 if there is an error.
+ */
+static int runBenchmarks(const char *path, int repeat) {
+    BenchContext context = {0};
+    char editPath[4096];
+    char error[128];
+    uint64_t state = 42;
+
+    context.path = path;
+    rosterFileName = path;
+    context.students = readFile();
+    if (context.students == NULL || loadLines(&context) != 0) {
+        return 1;
+    }
+    while (context.students[context.count].id != 0) {
+        context.count++;
+    }
+
+    context.scratch = malloc((context.numLines + context.count + 1) * sizeof(Student));
+    context.lookupIds = malloc(LOOKUPS * sizeof(int));
+    context.devNull = fopen("/dev/null", "w");
+    if (context.scratch == NULL || context.lookupIds == NULL || context.devNull == NULL
+        || context.count == 0) {
+        fprintf(stderr, "Error preparing benchmarks for %s\n", path);
+        return 1;
+    }
+    for (size_t l = 0; l < LOOKUPS; l++) {
+        context.lookupIds[l] = context.students[nextRandom(&state) % context.count].id;
+    }
+
+    measure(&context, "load", benchLoad, NULL, context.count, repeat);
+    measure(&context, "parse", benchParse, NULL, context.numLines, repeat);
+
+    for (int column = SORT_ID; column <= SORT_COLUMN_COUNT; column++) {
+        char name[32];
+        snprintf(name, sizeof(name), "sort_%s", columnLabels[column]);
+        context.spec.count = 1;
+        context.spec.keys[0].column = (SortColumn)column;
+        context.spec.keys[0].descending = column == SORT_EXAM || column == SORT_TOTAL;
+        measure(&context, name, benchSort, NULL, context.count, repeat);
+    }
+    parseSortSpec("-4 2 1", &context.spec);
+    measure(&context, "sort_total_last_id", benchSort, NULL, context.count, repeat);
+
+    measure(&context, "totals", benchTotals, NULL, context.count, repeat);
+    measure(&context, "histogram", benchHistogram, NULL, context.count, repeat);
+    compileQuery("final < 20 and grade = F", &context.query, error, sizeof(error));
+    measure(&context, "query", benchQuery, NULL, context.count, repeat);
+    context.query.count = 0;
+    measure(&context, "top10", benchTop, NULL, context.count, repeat);
+    measure(&context, "lookup", benchLookup, NULL, LOOKUPS, repeat);
+
+    // Edits and saves go through the roster cache, on a copy of the roster;
+    // the cache and undo history left by the previous roster are dropped first
+    snprintf(editPath, sizeof(editPath), "%s.edit", path);
+    resetRoster();
+    clearHistory();
+    rosterFileName = editPath;
+    if (writeToFile(context.students) != 0) {
+        fprintf(stderr, "Error preparing benchmarks for %s\n", path);
+        return 1;
+    }
+    measure(&context, "update", benchUpdate, restoreRoster, EDITS, repeat);
+    measure(&context, "delete", benchDelete, restoreRoster, EDITS, repeat);
+    measure(&context, "save", benchSave, restoreRoster, context.count, repeat);
+    unlink(editPath);
+    measure(&context, "export_csv", benchExport, NULL, context.count, repeat);
+
+    fclose(context.devNull);
+    free(context.students);
+    free(context.scratch);
+    free(context.fileData);
+    free(context.lines);
+    free(context.lookupIds);
+    return 0;
+}
+
+/**
+ * Parses a count such as 10000, 10k or 10M.
+ *
+ * @param text The text to parse.
+ * @return The count, or 0 if the text is not a count.
+ */
+static size_t parseCount(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+    if (*end == 'k' || *end == 'K') {
+        value *= 1e3;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        value *= 1e6;
+        end++;
+    }
+    return (*end == '\0' && value >= 1) ? (size_t)value : 0;
+}
+
+/**
+ * Parses generator options from the command line.
+ *
+ *   --seed <n>  --names <min>-<max>  --dist <uniform|normal|bimodal>
+ *
+ * @param argc The argument count.
+ * @param argv The arguments.
+ * @param first The index of the first option.
+ * @param options The options to fill in.
+ * @return 0 on success, -1 on an invalid option.
+ */
+static int parseGeneratorOptions(int argc, char *argv[], int first, GeneratorOptions *options) {
+    for (int i = first; i < argc; i++) {
+        if (i + 1 >= argc) {
+            return -1;
+        }
+        if (strcmp(argv[i], "--seed") == 0) {
+            options->seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--names") == 0) {
+            if (sscanf(argv[++i], "%d-%d", &options->minNameLength, &options->maxNameLength) != 2
+                || options->minNameLength < 1 || options->maxNameLength > 49
+                || options->minNameLength > options->maxNameLength) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--dist") == 0) {
+            i++;
+            if (strcmp(argv[i], "uniform") == 0) {
+                options->distribution = DIST_UNIFORM;
+            } else if (strcmp(argv[i], "normal") == 0) {
+                options->distribution = DIST_NORMAL;
+            } else if (strcmp(argv[i], "bimodal") == 0) {
+                options->distribution = DIST_BIMODAL;
+            } else {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--repeat") != 0) {
+            return -1;
+        } else {
+            i++;  // --repeat is read by the caller
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns the value of --repeat, or 3 if it is not given.
+ *
+ * @param argc The argument count.
+ * @param argv The arguments.
+ * @return The number of runs per benchmark.
+ */
+static int parseRepeat(int argc, char *argv[]) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && atoi(argv[i + 1]) > 0) {
+            return atoi(argv[i + 1]);
+        }
+    }
+    return 3;
+}
+
+/**
+ * Prints how to run the generator and the benchmarks.
+ *
+ * @param program The program name.
+ */
+static void printUsage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s generate <count> <file> [options]   write a synthetic roster\n"
+            "       %s run <file> [--repeat n]            benchmark one roster\n"
+            "       %s all [sizes...] [options]           generate and benchmark each size\n"
+            "\n"
+            "Counts accept k and M suffixes (e.g. 10k, 10M); all defaults to 10k 100k 1M.\n"
+            "Options: --seed <n>  --names <min>-<max>  --dist <uniform|normal|bimodal>\n"
+            "         --repeat <n>\n",
+            program, program, program);
+}
+
+int main(int argc, char *argv[]) {
+    GeneratorOptions options = {0, 348, 3, 10, DIST_NORMAL};
+
+    if (argc >= 4 && strcmp(argv[1], "generate") == 0) {
+        options.count = parseCount(argv[2]);
+        if (options.count == 0 || parseGeneratorOptions(argc, argv, 4, &options) != 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return generateRoster(argv[3], &options) == 0 ? 0 : 1;
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "run") == 0) {
+        return runBenchmarks(argv[2], parseRepeat(argc, argv));
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "all") == 0) {
+        static char *defaultSizes[] = {"10k", "100k", "1M"};
+        char **sizes = defaultSizes;
+        int numSizes = 3;
+        int firstOption = 2;
+        while (firstOption < argc && strncmp(argv[firstOption], "--", 2) != 0) {
+            firstOption++;
+        }
+        if (firstOption > 2) {
+            sizes = argv + 2;
+            numSizes = firstOption - 2;
+        }
+        if (parseGeneratorOptions(argc, argv, firstOption, &options) != 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        for (int s = 0; s < numSizes; s++) {
+            char path[64];
+            options.count = parseCount(sizes[s]);
+            if (options.count == 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            snprintf(path, sizeof(path), "bench_%zu.txt", options.count);
+            fprintf(stderr, "Generating %zu students...\n", options.count);
+            if (generateRoster(path, &options) != 0
+                || runBenchmarks(path, parseRepeat(argc, argv)) != 0) {
+                unlink(path);
+                return 1;
+            }
+            unlink(path);
+        }
+        return 0;
+    }
+
+    printUsage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,134 @@
+#include <string.h>
+#include <ctype.h>
+#include "collate.h"
+#include "student.h"
+
+// Run of accented code points that all fold to the same base letters
+typedef struct {
+    unsigned int first;
+    unsigned int last;
+    const char *folded;
+} FoldRun;
+
+// Latin-1 Supplement and Latin Extended-A, sorted by code point
+static const FoldRun foldRuns[] = {
+    {0x00C0, 0x00C5, "a"},  {0x00C6, 0x00C6, "ae"}, {0x00C7, 0x00C7, "c"},
+    {0x00C8, 0x00CB, "e"},  {0x00CC, 0x00CF, "i"},  {0x00D0, 0x00D0, "d"},
+    {0x00D1, 0x00D1, "n"},  {0x00D2, 0x00D6, "o"},  {0x00D7, 0x00D7, ""},
+    {0x00D8, 0x00D8, "o"},  {0x00D9, 0x00DC, "u"},  {0x00DD, 0x00DD, "y"},
+    {0x00DE, 0x00DE, "th"}, {0x00DF, 0x00DF, "ss"}, {0x00E0, 0x00E5, "a"},
+    {0x00E6, 0x00E6, "ae"}, {0x00E7, 0x00E7, "c"},  {0x00E8, 0x00EB, "e"},
+    {0x00EC, 0x00EF, "i"},  {0x00F0, 0x00F0, "d"},  {0x00F1, 0x00F1, "n"},
+    {0x00F2, 0x00F6, "o"},  {0x00F7, 0x00F7, ""},   {0x00F8, 0x00F8, "o"},
+    {0x00F9, 0x00FC, "u"},  {0x00FD, 0x00FD, "y"},  {0x00FE, 0x00FE, "th"},
+    {0x00FF, 0x00FF, "y"},  {0x0100, 0x0105, "a"},  {0x0106, 0x010D, "c"},
+    {0x010E, 0x0111, "d"},  {0x0112, 0x011B, "e"},  {0x011C, 0x0123, "g"},
+    {0x0124, 0x0127, "h"},  {0x0128, 0x0131, "i"},  {0x0132, 0x0133, "ij"},
+    {0x0134, 0x0135, "j"},  {0x0136, 0x0138, "k"},  {0x0139, 0x0142, "l"},
+    {0x0143, 0x014B, "n"},  {0x014C, 0x0151, "o"},  {0x0152, 0x0153, "oe"},
+    {0x0154, 0x0159, "r"},  {0x015A, 0x0161, "s"},  {0x0162, 0x0167, "t"},
+    {0x0168, 0x0173, "u"},  {0x0174, 0x0175, "w"},  {0x0176, 0x0178, "y"},
+    {0x0179, 0x017E, "z"},  {0x017F, 0x017F, "s"},
+};
+
+/**
+ * Looks up the base letters an accented code point folds to.
+ *
+ * @param codePoint The Unicode code point to fold.
+ * @return The folded letters, or NULL if the code point is not covered.
+ */
+static const char *lookupFold(unsigned int codePoint) {
+    size_t low = 0;
+    size_t high = sizeof(foldRuns) / sizeof(foldRuns[0]);
+
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (codePoint < foldRuns[mid].first) {
+            high = mid;
+        } else if (codePoint > foldRuns[mid].last) {
+            low = mid + 1;
+        } else {
+            return foldRuns[mid].folded;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Folds a name into its primary collation key.
+ *
+ * ASCII letters are lowercased, accented Latin letters (UTF-8) are reduced to
+ * their base letters, and spaces and punctuation are dropped so that
+ * "O'Brien", "obrien" and "Ó Brien" all produce the same key. Any other byte
+ * is copied unchanged. The key is zero padded up to keySize so it can be
+ * compared with memcmp.
+ *
+ * @param name The name to fold.
+ * @param key The buffer that receives the folded key.
+ * @param keySize The size of the key buffer.
+ * @return The length of the folded key.
+ */
+size_t foldName(const char *name, char *key, size_t keySize) {
+    const unsigned char *p = (const unsigned char *)name;
+    size_t length = 0;
+
+    while (*p != '\0' && length + 1 < keySize) {
+        if (isalnum(*p)) {
+            key[length++] = (char)tolower(*p);
+            p++;
+        } else if (*p < 0x80) {
+            p++;  // Spaces and punctuation do not take part in ordering
+        } else if ((*p & 0xE0) == 0xC0 && (p[1] & 0xC0) == 0x80) {
+            unsigned int codePoint = ((p[0] & 0x1Fu) << 6) | (p[1] & 0x3Fu);
+            const char *folded = lookupFold(codePoint);
+            if (folded != NULL) {
+                while (*folded != '\0' && length + 1 < keySize) {
+                    key[length++] = *folded++;
+                }
+            } else if (length + 2 < keySize) {
+                key[length++] = (char)p[0];
+                key[length++] = (char)p[1];
+            }
+            p += 2;
+        } else {
+            key[length++] = (char)*p++;
+        }
+    }
+
+    memset(key + length, 0, keySize - length);
+    return length;
+}
+
+/**
+ * Builds the full collation key of a student.
+ *
+ * The key is the folded last name followed by the folded first name, each in
+ * a zero padded slot of NAME_KEY_SIZE bytes, so the first name breaks ties
+ * between equal last names.
+ *
+ * @param student The student to build the key for.
+ * @param key A buffer of COLLATION_KEY_SIZE bytes.
+ */
+void buildCollationKey(const Student *student, char *key) {
+    foldName(student->lastName, key, NAME_KEY_SIZE);
+    foldName(student->firstName, key + NAME_KEY_SIZE, NAME_KEY_SIZE);
+}
+
+/**
+ * Packs the first eight bytes of a key into an integer.
+ *
+ * The bytes are packed big-endian so that comparing two prefixes as integers
+ * orders them exactly like memcmp on the same bytes.
+ *
+ * @param key A key of at least eight bytes.
+ * @return The packed prefix.
+ */
+uint64_t collationPrefix(const char *key) {
+    const unsigned char *bytes = (const unsigned char *)key;
+    uint64_t prefix = 0;
+
+    for (int i = 0; i < 8; i++) {
+        prefix = (prefix << 8) | bytes[i];
+    }
+    return prefix;
+}
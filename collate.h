@@ -0,0 +1,15 @@
+#ifndef COLLATE_H
+#define COLLATE_H
+#include <stddef.h>
+#include <stdint.h>
+#include "student.h"
+
+// A folded name never grows past the buffer it came from
+#define NAME_KEY_SIZE 50
+// Last name key followed by first name key, each zero padded
+#define COLLATION_KEY_SIZE (2 * NAME_KEY_SIZE)
+
+size_t foldName(const char *name, char *key, size_t keySize);
+void buildCollationKey(const Student *student, char *key);
+uint64_t collationPrefix(const char *key);
+#endif // COLLATE_H
@@ -1,13 +1,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include "data.h"
 #include "student.h"
 #include "spreadsheet.h"
+#include "sort.h"
+#include "query.h"
+#include "roster.h"
+#include "perf.h"
+#include "history.h"
 
-#define MAX_STUDENTS 1000
+// Longest row writeStudents can produce: both names full, every int at
+// 11 characters ("-2147483648"), seven separators, newline and NUL
+#define MAX_LINE_LENGTH (2 * 50 + 6 * 11 + 9)
 
-int sortColumn = 1; // Default sort column (1 = Student ID)
+const char *rosterFileName = "students.txt";
+
+SortSpec sortSpec = {{{SORT_ID, 0}}, 1}; // Default sort (Student ID ascending)
+Query activeFilter = {0}; // Empty query matches every student
 
 // Initial grade mappings
 int gradeA = 80;
@@ -17,126 +30,164 @@ int gradeD = 50;
 int gradeF = 0;
 
 /**
- * Compares two students by their student ID.
- *
- * This comparison is used for sorting a list of students.
+ * Asks the user to choose the columns to sort the spreadsheet by.
  *
- * @param a Pointer to the first student.
- * @param b Pointer to the second student.
+ * The user is presented with a menu and asked to enter up to MAX_SORT_KEYS
+ * column numbers in priority order, each optionally prefixed with '+' for
+ * ascending or '-' for descending (e.g. "-4 2 1" sorts by total, then last
+ * name, then student ID). The function loops until the user enters a valid
+ * specification, which is stored in the global variable sortSpec.
  *
- * @return A negative value if studentA's ID is less than studentB's ID,
- *         zero if studentA's ID is equal to studentB's ID, and a positive
- *         value if studentA's ID is greater than studentB's ID.
+ * @return 1 when the user chose a valid choice if not loops until valid input
  */
-int compareByID(const void *a, const void *b) {
-    Student *studentA = (Student *)a;
-    Student *studentB = (Student *)b;
-    return (studentA->id - studentB->id);
+int selectSortColumn() {
+    int sortChosen = 0;
+    char input[64];
+    char description[160];
+    while (!sortChosen) {
+        printf("Column Options\n");
+        printf("--------------\n");
+        printf("1. Student ID\n");
+        printf("2. Last name\n");
+        printf("3. Exam\n");
+        printf("4. Total\n");
+        printf("5. First name\n");
+        printf("6. Assignment 1\n");
+        printf("7. Assignment 2\n");
+        printf("8. Assignment 3\n");
+        printf("9. Midterm\n\n");
+        printf("Enter up to %d columns in priority order (e.g. 4 2 1).\n", MAX_SORT_KEYS);
+        printf("Prefix a column with + for ascending or - for descending.\n\n");
+        printf("Sort Columns: ");
+        scanf(" %63[^\n]", input);
+
+        // Drain the rest of the line; a spec too long for input is rejected
+        int next = getchar();
+        int tooLong = next != '\n' && next != EOF;
+        if (tooLong) {
+            clearInputBuffer();
+        }
+
+        if (!tooLong && parseSortSpec(input, &sortSpec) == 0) {
+            formatSortSpec(&sortSpec, description, sizeof(description));
+            printf("Sort column updated: %s\n\n", description);
+            sortChosen = 1;  // Exit loop when valid input is given
+        } else {
+            system("clear");
+            printf("Invalid choice. Please try again.\n\n");
+        }
+    }
+    return sortChosen;
 }
 
 /**
- * Compares two students by their last name.
- *
- * The comparison is case-sensitive and uses the strcmp function.
+ * Evaluates a filter over the students.
  *
- * @param a a pointer to the first student
- * @param b a pointer to the second student
- * @return a negative value if studentA's last name is less than studentB's last name,
- *         a positive value if studentA's last name is greater than studentB's last name,
- *         and 0 if the last names are equal.
+ * @param filter The compiled filter; an empty filter matches every student.
+ * @param students Pointer to the array of Student structs.
+ * @param numStudents The number of students in the array.
+ * @return A newly allocated array with a match flag per student, or NULL if
+ *         memory cannot be allocated. The caller frees it.
  */
-int compareByLastName(const void *a, const void *b) {
-    Student *studentA = (Student *)a;
-    Student *studentB = (Student *)b;
-    return strcmp(studentA->lastName, studentB->lastName);
+unsigned char *matchFilter(const Query *filter, const Student *students, size_t numStudents) {
+    unsigned char *matches = malloc(numStudents + 1);
+    if (matches == NULL) {
+        perror("Error allocating memory for filter");
+        return NULL;
+    }
+    evaluateQuery(filter, students, numStudents, matches);
+    return matches;
 }
 
 /**
- * Compares two students by their final exam grade.
- *
- * The comparison is done in descending order.
+ * Prints the column headings of the spreadsheet table.
  *
- * @param a a pointer to the first student
- * @param b a pointer to the second student
- * @return a negative value if studentA's exam grade is less than studentB's exam grade,
- *         a positive value if studentA's exam grade is greater than studentB's exam grade,
- *         and 0 if the exam grades are equal.
+ * @param out The stream to print to.
  */
-int compareByExamGrade(const void *a, const void *b) {
-    int examGradeA = ((Student *)a)->final;
-    int examGradeB = ((Student *)b)->final;
-
-    return examGradeB - examGradeA;
+void printTableHeader(FILE *out) {
+    fprintf(out, "ID    Last        First       A1   A2   A3   Midterm   Exam   Total   Grade\n");
+    fprintf(out, "----  ----------  ----------  ---- ---- ---- -------- ------- ------  -----\n");
 }
 
 /**
- * Compares two students by their total course grade.
+ * Prints one student as a row of the spreadsheet table.
  *
- * The comparison is done in descending order.
+ * The grade is calculated by calling calculateGrade on the total.
+ * The total is calculated by calling calculateTotal on the student grades.
  *
- * @param a a pointer to the first student
- * @param b a pointer to the second student
- * @return a negative value if studentA's total grade is less than studentB's total grade,
- *         a positive value if studentA's total grade is greater than studentB's total grade,
- *         and 0 if the total grades are equal.
+ * @param out The stream to print to.
+ * @param student The student to print.
  */
-int compareByTotal(const void *a, const void *b) {
-    float totalA = calculateTotal(*(Student *)a);
-    float totalB = calculateTotal(*(Student *)b);
-    return (totalB > totalA) - (totalB < totalA);
+void printStudentRow(FILE *out, const Student *student) {
+    float total = calculateTotal(*student);
+    char grade = calculateGrade(total);
+
+    fprintf(out, "%-4d  %-10s  %-10s  %-4d %-4d %-4d %-8d %-7d %-7.2f  %c\n",
+            student->id,
+            student->lastName,
+            student->firstName,
+            student->asst1,
+            student->asst2,
+            student->asst3,
+            student->midterm,
+            student->final,
+            total,
+            grade);
 }
 
-
 /**
- * Asks the user to choose a column to sort the spreadsheet by.
+ * Prints the spreadsheet of students and their grades.
  *
- * The user is presented with a menu and asked to enter the number of their
- * chosen column. The function loops until the user enters a valid column
- * number (1-4). The chosen column is stored in the global variable sortColumn.
+ * The spreadsheet is sorted according to spec without reordering the
+ * students; students that tie on every sort column keep their order in the
+ * file. Only students matching the filter are shown.
  *
- * @return 1 when the user chose a valid choice if not loops until valid input
+ * The spreadsheet is printed in the following format:
+ *
+ * ID    Last        First       A1   A2   A3   Midterm   Exam   Total   Grade
+ * ----  ----------  ----------  ---- ---- ---- -------- ------- ------  -----
+ * <id>  <lastName>  <firstName> <A1> <A2> <A3> <midterm> <exam> <total> <grade>
+ *
+ * @param out The stream to print to.
+ * @param students Pointer to the array of Student structs.
+ * @param numStudents The number of students in the array.
+ * @param spec The sort columns.
+ * @param filter The filter limiting which students are shown.
  */
-int selectSortColumn() {
-    int sortChosen = 0;
-    int choice;
-    while (!sortChosen) {
-        printf("Column Options\n");
-        printf("--------------\n");
-        printf("1. Student ID\n");
-        printf("2. Last name\n");
-        printf("3. Exam\n");
-        printf("4. Total\n\n");
-        printf("Sort Column: ");
-        scanf("%d", &choice);
+void printSpreadSheet(FILE *out, const Student *students, size_t numStudents,
+                      const SortSpec *spec, const Query *filter) {
+    size_t *order = sortOrder(students, numStudents, spec);
+    unsigned char *matches = matchFilter(filter, students, numStudents);
+    if (order == NULL || matches == NULL) {
+        free(order);
+        free(matches);
+        return;
+    }
 
-        if (choice >= 1 && choice <= 4) {
-            sortColumn = choice;
-            printf("Sort column updated\n\n");
-            sortChosen = 1;  // Exit loop when valid input is given
-        } else {
-            clearInputBuffer();
-            system("clear");
-            printf("Invalid choice. Please try again.\n\n");
+    // Print the sorted spreadsheet
+    fprintf(out, "COMP 348 GRADE SHEET\n\n");
+    if (filter->count > 0) {
+        fprintf(out, "Filter: %s\n\n", filter->text);
+    }
+    printTableHeader(out);
+
+    for (size_t i = 0; i < numStudents; i++) {
+        if (matches[order[i]]) {
+            printStudentRow(out, &students[order[i]]);
         }
     }
-    return sortChosen;
+    fprintf(out, "\n");
+    free(order);
+    free(matches);
 }
 
 /**
  * Displays the spreadsheet of students and their grades.
  *
  * This function takes a pointer to the start of an array of Student structs as
- * input and displays the spreadsheet in the console. The spreadsheet is sorted
- * according to the global variable sortColumn.
- *
- * The spreadsheet is displayed in the following format:
- *
- * ID    Last        First       A1   A2   A3   Midterm   Exam   Total   Grade
- * ----  ----------  ----------  ---- ---- ---- -------- ------- ------  -----
- * <id>  <lastName>  <firstName> <A1> <A2> <A3> <midterm> <exam> <total> <grade>
- *
- * The grade is calculated by calling calculateGrade on the total.
- * The total is calculated by calling calculateTotal on the student grades.
+ * input and displays the spreadsheet in the console, sorted according to the
+ * global variable sortSpec and limited to students matching the active
+ * filter. See printSpreadSheet for the format.
  *
  * @param students Pointer to the array of Student structs.
  */
@@ -146,44 +197,7 @@ void displaySpreadSheet(Student *students) {
         numStudents++;
     }
 
-    // Sort based on the chosen sort column
-    switch (sortColumn) {
-        case 1:
-            qsort(students, numStudents, sizeof(Student), compareByID);
-            break;
-        case 2:
-            qsort(students, numStudents, sizeof(Student), compareByLastName);
-            break;
-        case 3:
-            qsort(students, numStudents, sizeof(Student), compareByExamGrade);
-            break;
-        case 4:
-            qsort(students, numStudents, sizeof(Student), compareByTotal);
-            break;
-    }
-
-    // Display the sorted spreadsheet
-    printf("COMP 348 GRADE SHEET\n\n");
-    printf("ID    Last        First       A1   A2   A3   Midterm   Exam   Total   Grade\n");
-    printf("----  ----------  ----------  ---- ---- ---- -------- ------- ------  -----\n");
-
-    for (size_t i = 0; i < numStudents; i++) {
-        float total = calculateTotal(students[i]);
-        char grade = calculateGrade(total);
-
-        printf("%-4d  %-10s  %-10s  %-4d %-4d %-4d %-8d %-7d %-7.2f  %c\n",
-               students[i].id,
-               students[i].lastName,
-               students[i].firstName,
-               students[i].asst1,
-               students[i].asst2,
-               students[i].asst3,
-               students[i].midterm,
-               students[i].final,
-               total,
-               grade);
-    }
-    printf("\n");
+    printSpreadSheet(stdout, students, numStudents, &sortSpec, &activeFilter);
 }
 
 /**
@@ -196,6 +210,7 @@ void displaySpreadSheet(Student *students) {
  * @return The total course grade for the student.
  */
 float calculateTotal(Student student) {
+    PERF_COUNT(PERF_CALCULATE_TOTAL);
     float assignmentTotal = ((student.asst1 + student.asst2 + student.asst3) / 120.0) * 25.0;
     float midtermTotal = (student.midterm / 25.0) * 25.0;
     float finalTotal = (student.final / 40.0) * 50.0;
@@ -217,6 +232,66 @@ char calculateGrade(float total) {
     }
 }
 
+/**
+ * Reads student lines from an open file and appends them to an array.
+ *
+ * The array grows as needed and is always terminated by a student with ID 0.
+ * Lines that do not start with a student ID (e.g. blank lines) are skipped.
+ * If hash is not NULL, every byte read is folded into it with hashBytes.
+ *
+ * @param file The file to read from, positioned at the start of a line.
+ * @param students The array to append to; may point to NULL to start one.
+ * @param count The number of students in the array, updated on return.
+ * @param capacity The number of Student slots allocated, updated on return.
+ * @param hash The running content hash, or NULL.
+ * @return 0 on success, -1 if memory cannot be allocated.
+ */
+int readStudents(FILE *file, Student **students, size_t *count, size_t *capacity,
+                 uint64_t *hash) {
+    char *line = NULL;
+    size_t bufferSize = 0;
+    ssize_t length;
+    int result = 0;
+    uint64_t start = PERF_START();
+
+    do {
+        // Keep room for the next student and the terminating ID 0
+        if (*count + 2 > *capacity) {
+            size_t newCapacity = *capacity < 64 ? 64 : *capacity * 2;
+            Student *grown = realloc(*students, newCapacity * sizeof(Student));
+            if (grown == NULL) {
+                perror("Error allocating memory for students array");
+                result = -1;
+                break;
+            }
+            *students = grown;
+            *capacity = newCapacity;
+        }
+
+        length = getline(&line, &bufferSize, file);
+        if (length != -1) {
+            PERF_ADD(PERF_BYTES_READ, (uint64_t)length);
+            if (hash != NULL) {
+                *hash = hashBytes(*hash, line, (size_t)length);
+            }
+
+            Student *student = &(*students)[*count];
+            memset(student, 0, sizeof(Student));
+            parseLine(line, student);
+            if (student->id != 0) {
+                (*count)++;
+            }
+        }
+    } while (length != -1);
+
+    free(line);
+    if (*students != NULL) {
+        memset(&(*students)[*count], 0, sizeof(Student));
+    }
+    PERF_STOP(PERF_READ_STUDENTS, start);
+    return result;
+}
+
 /**
  * Reads the student data from a file and returns an array of Student structures.
  *
@@ -225,49 +300,78 @@ char calculateGrade(float total) {
  *   ...
  *
  * The function allocates memory for the students array and populates it with the
- * student data from the file. If the file cannot be opened or if there is an error
- * allocating memory, the function returns NULL.
+ * student data from the file. The array is terminated by a student with ID 0.
+ * The file is read under a shared lock so that it is never seen half written.
+ * If the file cannot be opened or if there is an error allocating memory, the
+ * function returns NULL.
  *
  * @return An array of Student structures, or NULL if there is an error.
  */
 Student* readFile() {
-    const char *filename = "students.txt";
-    FILE *file = fopen(filename, "r");
+    FILE *file = fopen(rosterFileName, "r");
     if (file == NULL) {
         perror("Error opening file");
         return NULL;
     }
+    flock(fileno(file), LOCK_SH);
 
-    Student *students = malloc(MAX_STUDENTS * sizeof(Student));
-    if (students == NULL) {
-        perror("Error allocating memory for students array");
-        fclose(file);
-        return NULL;
+    Student *students = NULL;
+    size_t studentCount = 0;
+    size_t capacity = 0;
+    if (readStudents(file, &students, &studentCount, &capacity, NULL) != 0) {
+        free(students);
+        students = NULL;
     }
 
-    size_t studentCount = 0;
-    char *line = NULL;
-    size_t bufferSize = 0;
+    fclose(file);  // Closing the file releases the lock
+    return students;
+}
 
-    while (getline(&line, &bufferSize, file) != -1 && studentCount < MAX_STUDENTS) {
-        parseLine(line, &students[studentCount]);
-        studentCount++;
+/**
+ * Writes students to an open file, one line each.
+ *
+ * Each student is written in the following format:
+ *   Student ID|Last name|First name|Assignment 1|Assignment 2|Assignment 3|Midterm|Final
+ *
+ * If hash is not NULL, every byte written is folded into it with hashBytes.
+ *
+ * @param file The file to write to.
+ * @param students An array of Student structures terminated by ID 0.
+ * @param hash The running content hash, or NULL.
+ * @return 0 if the write is successful, -1 if there is an error.
+ */
+int writeStudents(FILE *file, const Student *students, uint64_t *hash) {
+    char line[MAX_LINE_LENGTH];
+    uint64_t start = PERF_START();
+
+    for (size_t i = 0; students[i].id != 0; i++) {
+        int length = snprintf(line, sizeof(line), "%d|%s|%s|%d|%d|%d|%d|%d\n",
+                              students[i].id,
+                              students[i].lastName,
+                              students[i].firstName,
+                              students[i].asst1,
+                              students[i].asst2,
+                              students[i].asst3,
+                              students[i].midterm,
+                              students[i].final);
+        if (hash != NULL) {
+            *hash = hashBytes(*hash, line, (size_t)length);
+        }
+        fwrite(line, 1, (size_t)length, file);
+        PERF_ADD(PERF_BYTES_WRITTEN, (uint64_t)length);
     }
 
-    free(line);
-    fclose(file);
-
-    return students;
+    int result = (fflush(file) == 0 && !ferror(file)) ? 0 : -1;
+    PERF_STOP(PERF_WRITE_STUDENTS, start);
+    return result;
 }
 
 /**
  * Writes the given array of Student structures to a file.
  *
- * The function opens the file named by the global constant filename in
- * overwrite mode and writes each student's data to the file in the following
- * format:
- *   Student ID|Last name|First name|Assignment 1|Assignment 2|Assignment 3|Midterm|Final
- *   ...
+ * The function opens the file named by the global rosterFileName, takes an
+ * exclusive lock, and only then truncates it and writes each student's data,
+ * so other instances never read or overwrite a half written file.
  *
  * If the file cannot be opened, the function prints an error message and
  * returns -1. If the write is successful, the function returns 0.
@@ -276,29 +380,21 @@ Student* readFile() {
  * @return 0 if the write is successful, -1 if there is an error.
  */
 int writeToFile(Student *students) {
-    const char *filename = "students.txt";
-    FILE *file = fopen(filename, "w");
+    int fd = open(rosterFileName, O_WRONLY | O_CREAT, 0644);
+    FILE *file = fd == -1 ? NULL : fdopen(fd, "w");
     if (file == NULL) {
         perror("Error opening file for writing");
+        if (fd != -1) {
+            close(fd);
+        }
         return -1;
     }
 
-    size_t i = 0;
-    while (students[i].id != 0 && i < MAX_STUDENTS) {
-        fprintf(file, "%d|%s|%s|%d|%d|%d|%d|%d\n",
-                students[i].id,
-                students[i].lastName,
-                students[i].firstName,
-                students[i].asst1,
-                students[i].asst2,
-                students[i].asst3,
-                students[i].midterm,
-                students[i].final);
-        i++;
-    }
+    flock(fd, LOCK_EX);
+    int result = ftruncate(fd, 0) == 0 ? writeStudents(file, students, NULL) : -1;
 
-    fclose(file);
-    return 0;
+    fclose(file);  // Closing the file releases the lock
+    return result;
 }
 
 
@@ -315,6 +411,7 @@ int writeToFile(Student *students) {
  * @param student The Student structure to populate with the parsed data.
  */
 void parseLine(char *line, Student *student) {
+    uint64_t start = PERF_START_SAMPLED(PERF_PARSE_LINE);
     sscanf(line, "%d|%[^|]|%[^|]|%d|%d|%d|%d|%d",
            &student->id,
            student->lastName,
@@ -324,34 +421,47 @@ void parseLine(char *line, Student *student) {
            &student->asst3,
            &student->midterm,
            &student->final);
+    PERF_STOP_SAMPLED(PERF_PARSE_LINE, start);
 }
 
 /**
- * Prints a line of asterisks to the console.
+ * Prints a line of asterisks.
  *
+ * @param out The stream to print to.
  * @param count The number of asterisks to print.
  */
-void printAsterisks(int count) {
+void printAsterisks(FILE *out, int count) {
     for (int i = 0; i < count; i++) {
-        printf("*");
+        fputc('*', out);
     }
-    printf("\n");
+    fputc('\n', out);
 }
 
 /**
- * Displays the grade distribution of the students.
+ * Prints the grade distribution of the students.
  *
- * This function takes a pointer to an array of Student structs as input and
- * displays the grade distribution in the console. The grade distribution is
- * displayed as a bar chart with asterisks, one for each letter grade.
+ * The grade distribution is printed as a bar chart with asterisks, one for
+ * each letter grade. Only students matching the filter are counted.
  *
+ * @param out The stream to print to.
  * @param students Pointer to the array of Student structs.
+ * @param numStudents The number of students in the array.
+ * @param filter The filter limiting which students are counted.
  */
-void displayGradeDistribution(Student *students) {
+void printGradeDistribution(FILE *out, const Student *students, size_t numStudents,
+                            const Query *filter) {
     int countA = 0, countB = 0, countC = 0, countD = 0, countF = 0;
 
-    size_t i = 0;
-    while (students[i].id != 0) {
+    unsigned char *matches = matchFilter(filter, students, numStudents);
+    if (matches == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < numStudents; i++) {
+        if (!matches[i]) {
+            continue;
+        }
+
         float total = calculateTotal(students[i]);
         char grade = calculateGrade(total);
 
@@ -372,28 +482,49 @@ void displayGradeDistribution(Student *students) {
                 countF++;
                 break;
         }
-        i++;
     }
+    free(matches);
 
-    // Display the grade distribution
-    printf("COMP 348 Grade Distribution\n\n");
+    // Print the grade distribution
+    fprintf(out, "COMP 348 Grade Distribution\n\n");
+    if (filter->count > 0) {
+        fprintf(out, "Filter: %s\n\n", filter->text);
+    }
 
-    printf("A: ");
-    printAsterisks(countA);
+    fprintf(out, "A: ");
+    printAsterisks(out, countA);
 
-    printf("B: ");
-    printAsterisks(countB);
+    fprintf(out, "B: ");
+    printAsterisks(out, countB);
 
-    printf("C: ");
-    printAsterisks(countC);
+    fprintf(out, "C: ");
+    printAsterisks(out, countC);
 
-    printf("D: ");
-    printAsterisks(countD);
+    fprintf(out, "D: ");
+    printAsterisks(out, countD);
 
-    printf("F: ");
-    printAsterisks(countF);
+    fprintf(out, "F: ");
+    printAsterisks(out, countF);
 
-    printf("\n");
+    fprintf(out, "\n");
+}
+
+/**
+ * Displays the grade distribution of the students.
+ *
+ * This function takes a pointer to an array of Student structs as input and
+ * displays the grade distribution of the students matching the active filter
+ * in the console. See printGradeDistribution for the format.
+ *
+ * @param students Pointer to the array of Student structs.
+ */
+void displayGradeDistribution(Student *students) {
+    size_t numStudents = 0;
+    while (students[numStudents].id != 0) {
+        numStudents++;
+    }
+
+    printGradeDistribution(stdout, students, numStudents, &activeFilter);
 }
 
 /**
@@ -402,8 +533,9 @@ void displayGradeDistribution(Student *students) {
  * This function takes a pointer to an array of Student structs as input and
  * prompts the user to enter a valid student ID. If the student ID is found, the
  * function prompts the user to enter a new last name and updates the student's
- * last name in the array. The function saves the changes to the file and
- * displays a confirmation message.
+ * last name in the array. The function saves the changes to the file (or keeps
+ * them for the open transaction) and displays a confirmation message. The
+ * change can be undone.
  *
  * If the student ID is not found, the function prompts the user to enter a
  * valid student ID again.
@@ -433,11 +565,14 @@ void updateLastName(Student *students) {
               scanf("%s", newLastName);
 
               // Update last name
+              beginEdit(students, &studentID, 1);
               strcpy(students[i].lastName, newLastName);
-              printf("Last name updated\n\n");
 
               // Save the changes to the file
-              if (writeToFile(students) != 0) {
+              int saved = finishEdit(students, "Update last name");
+              if (saved == 0) {
+                  printf("Last name updated\n\n");
+              } else if (saved < 0) {
                   printf("Error updating the file.\n");
               }
 
@@ -456,14 +591,60 @@ void updateLastName(Student *students) {
   }
 }
 
+/**
+ * Sets one student's exam grade and saves the change.
+ *
+ * The change is saved to the file (or kept for the open transaction) and can
+ * be undone. The caller has already validated the grade.
+ *
+ * @param students The array returned by loadRoster. It must not be used after
+ *                 this call; call loadRoster again.
+ * @param index The index of the student, as returned by findStudent.
+ * @param grade The new exam grade.
+ * @return 0 on success, ROSTER_CONFLICT if the change was not saved because the
+ *         row was edited elsewhere, -1 if the file could not be written.
+ */
+int setExamGrade(Student *students, size_t index, int grade) {
+    beginEdit(students, &students[index].id, 1);
+    students[index].final = grade;
+    return finishEdit(students, "Update exam grade");
+}
+
+/**
+ * Removes one student and saves the change.
+ *
+ * All the students after the removed one are shifted to the left. The change is
+ * saved to the file (or kept for the open transaction) and can be undone.
+ *
+ * @param students The array returned by loadRoster. It must not be used after
+ *                 this call; call loadRoster again.
+ * @param index The index of the student, as returned by findStudent.
+ * @return 0 on success, ROSTER_CONFLICT if the change was not saved because the
+ *         row was edited elsewhere, -1 if the file could not be written.
+ */
+int deleteStudentAt(Student *students, size_t index) {
+    int studentID = students[index].id;
+    beginEdit(students, &studentID, 1);
+
+    // Shift all the students after the removed student to the left
+    size_t j = index;
+    while (students[j].id != 0) {
+        students[j] = students[j + 1];
+        j++;
+    }
+
+    return finishEdit(students, "Delete student");
+}
+
 /**
  * Updates a student's exam grade.
  *
  * This function takes a pointer to an array of Student structs as input and
  * prompts the user to enter a valid student ID. If the student ID is found, the
  * function prompts the user to enter a new exam grade and updates the student's
- * exam grade in the array. The function saves the changes to the file and
- * displays a confirmation message.
+ * exam grade in the array. The function saves the changes to the file (or keeps
+ * them for the open transaction) and displays a confirmation message. The
+ * change can be undone.
  *
  * If the student ID is not found, the function prompts the user to enter a
  * valid student ID again.
@@ -484,40 +665,35 @@ void updateExamGrade(Student *students) {
         printf("\n");
 
         // Search for the student by ID
-        size_t i = 0;
-        while (students[i].id != 0) {
-            if (students[i].id == studentID) {
-                int isGradeValid = 0;
-                int newGrade;
-
-                // Loop until a valid grade is entered
-                while (!isGradeValid) {
-                    printf("Enter updated exam grade: ");
-                    scanf("%d", &newGrade);
-
-                    // Validate grade input
-                    if (newGrade >= 0 && newGrade <= 40) {
-                        isGradeValid = 1;
-                    } else {
-                        clearInputBuffer();
-                        system("clear");
-                        printf("Invalid grade. Please try again.\n\n");
-                    }
+        long index = findStudent(students, studentID);
+        if (index >= 0) {
+            int isGradeValid = 0;
+            int newGrade;
+
+            // Loop until a valid grade is entered
+            while (!isGradeValid) {
+                printf("Enter updated exam grade: ");
+                scanf("%d", &newGrade);
+
+                // Validate grade input
+                if (newGrade >= 0 && newGrade <= 40) {
+                    isGradeValid = 1;
+                } else {
+                    clearInputBuffer();
+                    system("clear");
+                    printf("Invalid grade. Please try again.\n\n");
                 }
+            }
 
-                // Update the student's final exam grade
-                students[i].final = newGrade;
+            // Update the grade and save the changes to the file
+            int saved = setExamGrade(students, (size_t)index, newGrade);
+            if (saved == 0) {
                 printf("Exam grade updated\n\n");
-
-                // Save the changes to the file
-                if (writeToFile(students) != 0) {
-                    printf("Error updating the file.\n");
-                }
-
-                found = 1; // Set found to true, break out of the loop
-                break;
+            } else if (saved < 0) {
+                printf("Error updating the file.\n");
             }
-            i++;
+
+            found = 1; // Set found to true, break out of the loop
         }
 
         // If student not found, prompt the user again
@@ -599,8 +775,9 @@ void updateGradeMappings() {
  * prompts the user to enter a valid student ID. If the student ID is found, the
  * function removes the student from the array, shifts all the students after the
  * removed student to the left, and marks the last student as removed by setting
- * its ID to 0. The function saves the updated student list to the file and
- * displays a confirmation message.
+ * its ID to 0. The function saves the updated student list to the file (or keeps
+ * it for the open transaction) and displays a confirmation message. The
+ * deletion can be undone.
  *
  * If the student ID is not found, the function prompts the user to enter a valid
  * student ID again.
@@ -610,12 +787,6 @@ void updateGradeMappings() {
 void removeStudent(Student *students) {
     int studentID;
     int found = 0;  // Track if the student is found
-    size_t numStudents = 0;
-
-    // Count the number of students
-    while (students[numStudents].id != 0 && numStudents < MAX_STUDENTS) {
-        numStudents++;
-    }
 
     // Loop until a valid student ID is entered
     while (!found) {
@@ -627,26 +798,16 @@ void removeStudent(Student *students) {
         printf("\n");
 
         // Search for the student by ID
-        for (size_t i = 0; i < numStudents; i++) {
-            if (students[i].id == studentID) {
-                found = 1;  // Student found
-
-                // Shift all the students after the found student to the left
-                for (size_t j = i; j < numStudents - 1; j++) {
-                    students[j] = students[j + 1];
-                }
-
-                // Mark the last student as removed by setting its ID to 0
-                students[numStudents - 1].id = 0;
+        long index = findStudent(students, studentID);
+        if (index >= 0) {
+            found = 1;  // Student found
 
+            // Remove the row and save the updated student list to the file
+            int saved = deleteStudentAt(students, (size_t)index);
+            if (saved == 0) {
                 printf("Student successfully deleted.\n\n");
-
-                // Save the updated student list to the file
-                if (writeToFile(students) != 0) {
-                    printf("Error updating the file.\n");
-                }
-
-                break;
+            } else if (saved < 0) {
+                printf("Error updating the file.\n");
             }
         }
 
@@ -657,4 +818,158 @@ void removeStudent(Student *students) {
             printf("Student ID %d not found. Please try again.\n\n", studentID);
         }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * Prompts the user for a query expression and compiles it.
+ *
+ * The function loops until the user enters an expression that compiles, or
+ * "none" to match every student.
+ *
+ * @param prompt The prompt to show.
+ * @param query The query to compile the expression into.
+ */
+void promptForQuery(const char *prompt, Query *query) {
+    int isValid = 0;
+    char input[MAX_QUERY_LENGTH];
+    char error[128];
+
+    while (!isValid) {
+        printf("Columns: id, last, first, asst1, asst2, asst3, midterm, final, total, grade\n");
+        printf("Example: final < 20 and grade = F\n\n");
+        printf("%s", prompt);
+        scanf(" %255[^\n]", input);
+
+        // Drain the rest of the line; a filter too long for input is rejected
+        int next = getchar();
+        int tooLong = next != '\n' && next != EOF;
+        if (tooLong) {
+            clearInputBuffer();
+            system("clear");
+            printf("Invalid filter: longer than %zu characters. Please try again.\n\n",
+                   sizeof(input) - 1);
+        } else if (strcmp(input, "none") == 0) {
+            query->count = 0;
+            query->depth = 0;
+            query->text[0] = '\0';
+            isValid = 1;
+        } else if (compileQuery(input, query, error, sizeof(error)) == 0) {
+            isValid = 1;
+        } else {
+            system("clear");
+            printf("Invalid filter: %s. Please try again.\n\n", error);
+        }
+    }
+}
+
+/**
+ * Sets the filter that limits which students are displayed.
+ *
+ * The filter is stored in the global variable activeFilter and applies to
+ * the spreadsheet and the histogram until it is changed or cleared.
+ *
+ * @param students Pointer to the array of Student structs.
+ */
+void setFilter(Student *students) {
+    promptForQuery("Filter (or none to clear): ", &activeFilter);
+
+    if (activeFilter.count == 0) {
+        printf("Filter cleared\n\n");
+        return;
+    }
+
+    size_t numStudents = 0;
+    while (students[numStudents].id != 0) {
+        numStudents++;
+    }
+
+    unsigned char *matches = matchFilter(&activeFilter, students, numStudents);
+    if (matches == NULL) {
+        return;
+    }
+    size_t numMatches = 0;
+    for (size_t i = 0; i < numStudents; i++) {
+        numMatches += matches[i];
+    }
+    free(matches);
+
+    printf("Filter updated: %zu of %zu students match\n\n", numMatches, numStudents);
+}
+
+/**
+ * Removes every student matching a query from the spreadsheet.
+ *
+ * This function prompts the user for a query, shows how many students match
+ * and asks for confirmation. On confirmation the matching students are
+ * removed, the remaining students are shifted left to close the gaps and the
+ * updated student list is saved to the file, or kept for the open
+ * transaction. The whole deletion can be undone as one edit.
+ *
+ * @param students Pointer to the array of Student structs.
+ */
+void removeMatchingStudents(Student *students) {
+    Query query;
+    char confirm;
+    size_t numStudents = 0;
+
+    while (students[numStudents].id != 0) {
+        numStudents++;
+    }
+
+    promptForQuery("Delete students where: ", &query);
+    if (query.count == 0) {
+        printf("No students deleted.\n\n");
+        return;
+    }
+
+    unsigned char *matches = malloc(numStudents + 1);
+    if (matches == NULL) {
+        perror("Error allocating memory for filter");
+        return;
+    }
+    size_t numMatches = evaluateQuery(&query, students, numStudents, matches);
+
+    printf("%zu of %zu students match. Delete them? (y/n): ", numMatches, numStudents);
+    scanf(" %c", &confirm);
+    if (numMatches == 0 || (confirm != 'y' && confirm != 'Y')) {
+        printf("No students deleted.\n\n");
+        free(matches);
+        return;
+    }
+
+    int *removedIds = malloc(numMatches * sizeof(int));
+    if (removedIds == NULL) {
+        perror("Error allocating memory for filter");
+        free(matches);
+        return;
+    }
+
+    size_t removed = 0;
+    for (size_t i = 0; i < numStudents; i++) {
+        if (matches[i]) {
+            removedIds[removed++] = students[i].id;
+        }
+    }
+    beginEdit(students, removedIds, removed);
+
+    // Keep the students that do not match, in order
+    size_t kept = 0;
+    for (size_t i = 0; i < numStudents; i++) {
+        if (!matches[i]) {
+            students[kept++] = students[i];
+        }
+    }
+    for (size_t i = kept; i < numStudents; i++) {
+        students[i].id = 0;
+    }
+    free(matches);
+
+    // Save the updated student list to the file
+    int saved = finishEdit(students, "Delete matching students");
+    if (saved == 0) {
+        printf("%zu students successfully deleted.\n\n", numMatches);
+    } else if (saved < 0) {
+        printf("Error updating the file.\n");
+    }
+    free(removedIds);
+}
@@ -1,21 +1,41 @@
 #ifndef DATASTORAGE_H
 #define DATASTORAGE_H
+#include <stdio.h>
+#include <stdint.h>
 #include "student.h"
+#include "query.h"
+#include "sort.h"
+
+extern const char *rosterFileName;
+extern SortSpec sortSpec;
+extern Query activeFilter;
 
 Student* readFile();
+int readStudents(FILE *file, Student **students, size_t *count, size_t *capacity,
+                 uint64_t *hash);
+int writeStudents(FILE *file, const Student *students, uint64_t *hash);
+int writeToFile(Student *students);
 void parseLine(char *line, Student *student);
+void printTableHeader(FILE *out);
+void printStudentRow(FILE *out, const Student *student);
+void printSpreadSheet(FILE *out, const Student *students, size_t numStudents,
+                      const SortSpec *spec, const Query *filter);
 void displaySpreadSheet(Student* students); // Function prototype
+void printGradeDistribution(FILE *out, const Student *students, size_t numStudents,
+                            const Query *filter);
 void displayGradeDistribution(Student *students);
 void updateGradeMappings();
 void updateLastName(Student *students);
+int setExamGrade(Student *students, size_t index, int grade);
+int deleteStudentAt(Student *students, size_t index);
 void updateExamGrade(Student *students);
 void removeStudent(Student *students);
 float calculateTotal(Student student);
 char calculateGrade(float total);
 int selectSortColumn();
 int getValidatedGrade(const char* gradeName);
-int compareByID(const void *a, const void *b);
-int compareByTotal(const void *a, const void *b);
-int compareByExamGrade(const void *a, const void *b);
-int compareByLastName(const void *a, const void *b);
+unsigned char *matchFilter(const Query *filter, const Student *students, size_t numStudents);
+void promptForQuery(const char *prompt, Query *query);
+void setFilter(Student *students);
+void removeMatchingStudents(Student *students);
 #endif // DATASTORAGE_H
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "export.h"
+#include "data.h"
+#include "query.h"
+#include "roster.h"
+#include "sort.h"
+#include "spreadsheet.h"
+#include "student.h"
+
+#define EXPORT_BUFFER_SIZE (1 << 20)
+// Longest row either format can produce, with every name byte escaped
+#define MAX_ROW_LENGTH 1024
+
+// Two buffers: the caller formats into one while the writer thread drains the other
+typedef struct {
+    int fd;
+    char *buffers[2];
+    size_t lengths[2];
+    int full[2];
+    int done;
+    int error;     // errno of the first failed write, or 0
+    int threaded;  // 0 if the writer thread could not start; handOff writes instead
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+} ExportWriter;
+
+/**
+ * Writes a whole buffer, retrying after interrupted or short writes.
+ *
+ * @param fd The file to write to.
+ * @param bytes The bytes to write.
+ * @param length The number of bytes.
+ * @return 0 on success, or the errno of the failed write.
+ */
+static int writeAll(int fd, const char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        bytes += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+/**
+ * Writes buffers handed over by the formatter until told to stop.
+ *
+ * Buffers are taken in the same alternating order they are filled, and each
+ * is marked empty again once written so the formatter can reuse it.
+ *
+ * @param arg The ExportWriter.
+ * @return NULL.
+ */
+static void *writeBuffers(void *arg) {
+    ExportWriter *writer = arg;
+    int next = 0;
+
+    pthread_mutex_lock(&writer->mutex);
+    for (;;) {
+        while (!writer->full[next] && !writer->done) {
+            pthread_cond_wait(&writer->changed, &writer->mutex);
+        }
+        if (!writer->full[next]) {
+            break;  // Done, and every buffer has been written
+        }
+        pthread_mutex_unlock(&writer->mutex);
+
+        // Write without holding the lock so formatting carries on meanwhile
+        int error = writeAll(writer->fd, writer->buffers[next], writer->lengths[next]);
+
+        pthread_mutex_lock(&writer->mutex);
+        if (writer->error == 0) {
+            writer->error = error;
+        }
+        writer->full[next] = 0;
+        pthread_cond_broadcast(&writer->changed);
+        next ^= 1;
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    return NULL;
+}
+
+/**
+ * Hands a filled buffer to the writer thread and waits for the other one.
+ *
+ * Without a writer thread the buffer is written here instead.
+ *
+ * @param writer The writer.
+ * @param current The buffer just filled; receives the buffer to fill next.
+ */
+static void handOff(ExportWriter *writer, int *current) {
+    if (!writer->threaded) {
+        int error = writeAll(writer->fd, writer->buffers[*current], writer->lengths[*current]);
+        if (writer->error == 0) {
+            writer->error = error;
+        }
+        writer->lengths[*current] = 0;
+        return;
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->full[*current] = 1;
+    pthread_cond_broadcast(&writer->changed);
+    *current ^= 1;
+    while (writer->full[*current]) {
+        pthread_cond_wait(&writer->changed, &writer->mutex);
+    }
+    writer->lengths[*current] = 0;
+    pthread_mutex_unlock(&writer->mutex);
+}
+
+/**
+ * Appends a name to a buffer as a CSV field.
+ *
+ * The field is quoted, with quotes doubled, only if it contains a comma,
+ * quote or line break.
+ *
+ * @param out Where to write the field.
+ * @param name The name.
+ * @return The number of bytes written.
+ */
+static size_t appendCsvField(char *out, const char *name) {
+    size_t length = 0;
+    if (strpbrk(name, ",\"\r\n") == NULL) {
+        length = strlen(name);
+        memcpy(out, name, length);
+        return length;
+    }
+
+    out[length++] = '"';
+    for (const char *p = name; *p != '\0'; p++) {
+        if (*p == '"') {
+            out[length++] = '"';
+        }
+        out[length++] = *p;
+    }
+    out[length++] = '"';
+    return length;
+}
+
+/**
+ * Appends a name to a buffer as a JSON string.
+ *
+ * @param out Where to write the string.
+ * @param name The name.
+ * @return The number of bytes written.
+ */
+static size_t appendJsonString(char *out, const char *name) {
+    size_t length = 0;
+    out[length++] = '"';
+    for (const unsigned char *p = (const unsigned char *)name; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') {
+            out[length++] = '\\';
+            out[length++] = (char)*p;
+        } else if (*p < 0x20) {
+            length += (size_t)sprintf(out + length, "\\u%04x", *p);
+        } else {
+            out[length++] = (char)*p;
+        }
+    }
+    out[length++] = '"';
+    return length;
+}
+
+/**
+ * Formats one student as a CSV or JSON Lines row.
+ *
+ * @param out Where to write the row; at least MAX_ROW_LENGTH bytes.
+ * @param format The export format.
+ * @param student The student.
+ * @return The number of bytes written.
+ */
+static size_t formatRow(char *out, ExportFormat format, const Student *student) {
+    float total = calculateTotal(*student);
+    char grade = calculateGrade(total);
+    size_t length = 0;
+
+    if (format == EXPORT_CSV) {
+        length += (size_t)sprintf(out, "%d,", student->id);
+        length += appendCsvField(out + length, student->lastName);
+        out[length++] = ',';
+        length += appendCsvField(out + length, student->firstName);
+        length += (size_t)sprintf(out + length, ",%d,%d,%d,%d,%d,%.2f,%c\n",
+                                  student->asst1, student->asst2, student->asst3,
+                                  student->midterm, student->final, total, grade);
+    } else {
+        length += (size_t)sprintf(out, "{\"id\":%d,\"last_name\":", student->id);
+        length += appendJsonString(out + length, student->lastName);
+        length += (size_t)sprintf(out + length, ",\"first_name\":");
+        length += appendJsonString(out + length, student->firstName);
+        length += (size_t)sprintf(out + length,
+                                  ",\"asst1\":%d,\"asst2\":%d,\"asst3\":%d,\"midterm\":%d,"
+                                  "\"final\":%d,\"total\":%.2f,\"grade\":\"%c\"}\n",
+                                  student->asst1, student->asst2, student->asst3,
+                                  student->midterm, student->final, total, grade);
+    }
+    return length;
+}
+
+/**
+ * Exports students to a CSV or JSON Lines file.
+ *
+ * Rows are formatted straight from the students into one of two fixed-size
+ * buffers. When a buffer fills it is handed to a background writer thread
+ * and formatting carries on in the other, so formatting overlaps disk I/O
+ * and memory use stays at two buffers however many rows are exported. If the
+ * thread cannot be started the buffers are written synchronously instead.
+ *
+ * Each row holds the student's fields plus the computed total and letter
+ * grade. CSV output starts with a header line.
+ *
+ * @param path The file to write.
+ * @param format The export format.
+ * @param students Pointer to the array of Student structs.
+ * @param numStudents The number of students in the array.
+ * @param order The order to export the students in, or NULL for roster order.
+ * @param matches A flag per student selecting who is exported, or NULL for all.
+ * @return The number of rows exported, or -1 if there is an error.
+ */
+long exportStudents(const char *path, ExportFormat format, const Student *students,
+                    size_t numStudents, const size_t *order, const unsigned char *matches) {
+    ExportWriter writer = {0};
+    pthread_t thread;
+    int current = 0;
+    long exported = 0;
+
+    writer.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer.fd == -1) {
+        perror("Error opening export file");
+        return -1;
+    }
+    writer.buffers[0] = malloc(EXPORT_BUFFER_SIZE);
+    writer.buffers[1] = malloc(EXPORT_BUFFER_SIZE);
+    if (writer.buffers[0] == NULL || writer.buffers[1] == NULL) {
+        perror("Error allocating memory for export buffers");
+        free(writer.buffers[0]);
+        free(writer.buffers[1]);
+        close(writer.fd);
+        return -1;
+    }
+    pthread_mutex_init(&writer.mutex, NULL);
+    pthread_cond_init(&writer.changed, NULL);
+    int error = pthread_create(&thread, NULL, writeBuffers, &writer);
+    if (error != 0) {
+        // Still export, just without overlapping formatting and writing
+        fprintf(stderr, "Error starting export writer (%s); writing synchronously\n",
+                strerror(error));
+    }
+    writer.threaded = error == 0;
+
+    if (format == EXPORT_CSV) {
+        const char *header = "id,last_name,first_name,asst1,asst2,asst3,midterm,final,total,grade\n";
+        writer.lengths[current] = strlen(header);
+        memcpy(writer.buffers[current], header, writer.lengths[current]);
+    }
+
+    for (size_t i = 0; i < numStudents; i++) {
+        size_t index = order != NULL ? order[i] : i;
+        if (matches != NULL && !matches[index]) {
+            continue;
+        }
+
+        if (EXPORT_BUFFER_SIZE - writer.lengths[current] < MAX_ROW_LENGTH) {
+            handOff(&writer, &current);
+        }
+        writer.lengths[current] += formatRow(writer.buffers[current] + writer.lengths[current],
+                                             format, &students[index]);
+        exported++;
+    }
+
+    // Hand over the last partial buffer, then let the writer drain and stop
+    if (writer.lengths[current] > 0) {
+        handOff(&writer, &current);
+    }
+    if (writer.threaded) {
+        pthread_mutex_lock(&writer.mutex);
+        writer.done = 1;
+        pthread_cond_broadcast(&writer.changed);
+        pthread_mutex_unlock(&writer.mutex);
+        pthread_join(thread, NULL);
+    }
+
+    if (close(writer.fd) != 0 && writer.error == 0) {
+        writer.error = errno;
+    }
+    if (writer.error != 0) {
+        fprintf(stderr, "Error writing export file: %s\n", strerror(writer.error));
+        exported = -1;
+    }
+
+    pthread_mutex_destroy(&writer.mutex);
+    pthread_cond_destroy(&writer.changed);
+    free(writer.buffers[0]);
+    free(writer.buffers[1]);
+    return exported;
+}
+
+/**
+ * Exports the spreadsheet to a CSV or JSON Lines file.
+ *
+ * This function prompts the user for a format and a file name, then exports
+ * the students matching the active filter in the current sort order, the
+ * same rows Display Spreadsheet shows.
+ *
+ * @param students Pointer to the array of Student structs.
+ */
+void exportRoster(Student *students) {
+    int format = 0;
+    char path[256];
+    size_t numStudents = 0;
+
+    while (students[numStudents].id != 0) {
+        numStudents++;
+    }
+
+    while (format != EXPORT_CSV && format != EXPORT_JSON_LINES) {
+        printf("Export Formats\n");
+        printf("--------------\n");
+        printf("1. CSV\n");
+        printf("2. JSON Lines\n\n");
+        printf("Format: ");
+        scanf("%d", &format);
+        if (format != EXPORT_CSV && format != EXPORT_JSON_LINES) {
+            clearInputBuffer();
+            system("clear");
+            printf("Invalid format. Please try again.\n\n");
+        }
+    }
+
+    printf("File name: ");
+    scanf(" %255[^\n]", path);
+
+    size_t *order = sortOrder(students, numStudents, &sortSpec);
+    unsigned char *matches = matchFilter(&activeFilter, students, numStudents);
+    if (order == NULL || matches == NULL) {
+        free(order);
+        free(matches);
+        return;
+    }
+
+    long exported = exportStudents(path, (ExportFormat)format, students, numStudents, order,
+                                   matches);
+    if (exported >= 0) {
+        printf("%ld students exported to %s\n\n", exported, path);
+    }
+
+    free(order);
+    free(matches);
+}
+
+/**
+ * Exports the roster from the command line.
+ *
+ *   ./main export <csv|jsonl> <file> [where <query>]
+ *
+ * Students are exported in file order, optionally limited by a query.
+ *
+ * @param argc The argument count.
+ * @param argv The arguments; argv[1] is "export".
+ * @return The process exit status.
+ */
+int runExportCommand(int argc, char *argv[]) {
+    ExportFormat format;
+    Query filter = {0};
+    char text[MAX_QUERY_LENGTH];
+    char error[128];
+
+    if (argc < 4 || (strcmp(argv[2], "csv") != 0 && strcmp(argv[2], "jsonl") != 0)
+        || (argc > 4 && strcmp(argv[4], "where") != 0) || argc == 5) {
+        fprintf(stderr, "Usage: %s export <csv|jsonl> <file> [where <query>]\n", argv[0]);
+        return 1;
+    }
+    format = strcmp(argv[2], "csv") == 0 ? EXPORT_CSV : EXPORT_JSON_LINES;
+
+    // The query may arrive as one argument or split over several
+    size_t length = 0;
+    text[0] = '\0';
+    for (int i = 5; i < argc && length < sizeof(text); i++) {
+        length += (size_t)snprintf(text + length, sizeof(text) - length, "%s%s",
+                                   i == 5 ? "" : " ", argv[i]);
+    }
+    if (argc > 5 && compileQuery(text, &filter, error, sizeof(error)) != 0) {
+        fprintf(stderr, "Invalid filter: %s\n", error);
+        return 1;
+    }
+
+    Student *students = loadRoster();
+    if (students == NULL) {
+        return 1;
+    }
+    size_t numStudents = 0;
+    while (students[numStudents].id != 0) {
+        numStudents++;
+    }
+
+    unsigned char *matches = matchFilter(&filter, students, numStudents);
+    if (matches == NULL) {
+        return 1;
+    }
+    long exported = exportStudents(argv[3], format, students, numStudents, NULL, matches);
+    free(matches);
+    if (exported < 0) {
+        return 1;
+    }
+
+    fprintf(stderr, "%ld students exported to %s\n", exported, argv[3]);
+    return 0;
+}
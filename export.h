@@ -0,0 +1,12 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+#include <stddef.h>
+#include "student.h"
+
+typedef enum { EXPORT_CSV = 1, EXPORT_JSON_LINES } ExportFormat;
+
+long exportStudents(const char *path, ExportFormat format, const Student *students,
+                    size_t numStudents, const size_t *order, const unsigned char *matches);
+void exportRoster(Student *students);
+int runExportCommand(int argc, char *argv[]);
+#endif // EXPORT_H
@@ -0,0 +1,699 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "history.h"
+#include "data.h"
+#include "roster.h"
+#include "spreadsheet.h"
+#include "student.h"
+
+// applyEdit result when a row no longer looks the way the edit expects
+#define HISTORY_STALE 2
+
+// One student's row before and after an edit
+typedef struct {
+    int id;
+    size_t position;    // Row index before the edit, or after it for an added row
+    int existedBefore;
+    int existsAfter;
+    Student before;
+    Student after;
+} RowChange;
+
+// One user action, such as a single update or a bulk delete
+typedef struct {
+    char description[64];
+    RowChange *changes;
+    size_t numChanges;
+} Edit;
+
+typedef struct {
+    Edit *edits;
+    size_t count;
+    size_t capacity;
+} EditStack;
+
+typedef struct {
+    int id;
+    size_t change;
+} IdEntry;
+
+static EditStack undoStack;
+static EditStack redoStack;
+
+// The edit between beginEdit and finishEdit
+static Edit pending;
+static const int *pendingIds;
+static size_t numPendingIds;
+
+static int transactionOpen;
+static size_t transactionBase;  // undoStack.count when the transaction began
+
+/**
+ * Counts the students in an array terminated by ID 0.
+ *
+ * @param students The students.
+ * @return The number of students.
+ */
+static size_t countStudents(const Student *students) {
+    size_t numStudents = 0;
+    while (students[numStudents].id != 0) {
+        numStudents++;
+    }
+    return numStudents;
+}
+
+static int compareIdEntries(const void *a, const void *b) {
+    int idA = ((const IdEntry *)a)->id;
+    int idB = ((const IdEntry *)b)->id;
+    return (idA > idB) - (idA < idB);
+}
+
+static int compareIds(const void *a, const void *b) {
+    int idA = *(const int *)a;
+    int idB = *(const int *)b;
+    return (idA > idB) - (idA < idB);
+}
+
+/**
+ * Finds the row of every change's student in one pass over the roster.
+ *
+ * The changed IDs are sorted once and each row is looked up among them, so
+ * a bulk edit costs O((n + k) log k) rather than one scan per student.
+ *
+ * @param students The students.
+ * @param numStudents The number of students.
+ * @param changes The changes.
+ * @param numChanges The number of changes.
+ * @return A malloc'd row index per change, -1 where the student is absent,
+ *         or NULL if memory cannot be allocated.
+ */
+static long *locateRows(const Student *students, size_t numStudents, const RowChange *changes,
+                        size_t numChanges) {
+    long *rows = malloc((numChanges + 1) * sizeof(long));
+    IdEntry *entries = malloc((numChanges + 1) * sizeof(IdEntry));
+    if (rows == NULL || entries == NULL) {
+        perror("Error allocating memory for edit history");
+        free(rows);
+        free(entries);
+        return NULL;
+    }
+
+    for (size_t c = 0; c < numChanges; c++) {
+        rows[c] = -1;
+        entries[c].id = changes[c].id;
+        entries[c].change = c;
+    }
+    qsort(entries, numChanges, sizeof(IdEntry), compareIdEntries);
+
+    for (size_t i = 0; i < numStudents && numChanges > 0; i++) {
+        IdEntry key = {students[i].id, 0};
+        IdEntry *found = bsearch(&key, entries, numChanges, sizeof(IdEntry), compareIdEntries);
+        if (found != NULL) {
+            rows[found->change] = (long)i;
+        }
+    }
+
+    free(entries);
+    return rows;
+}
+
+/**
+ * Collects the distinct student IDs touched by a run of edits.
+ *
+ * @param edits The edits.
+ * @param numEdits The number of edits.
+ * @param numIds Receives the number of IDs.
+ * @return A malloc'd array of IDs, or NULL if memory cannot be allocated.
+ */
+static int *collectIds(const Edit *edits, size_t numEdits, size_t *numIds) {
+    size_t total = 0;
+    for (size_t e = 0; e < numEdits; e++) {
+        total += edits[e].numChanges;
+    }
+
+    int *ids = malloc((total + 1) * sizeof(int));
+    if (ids == NULL) {
+        perror("Error allocating memory for edit history");
+        return NULL;
+    }
+    total = 0;
+    for (size_t e = 0; e < numEdits; e++) {
+        for (size_t c = 0; c < edits[e].numChanges; c++) {
+            ids[total++] = edits[e].changes[c].id;
+        }
+    }
+
+    qsort(ids, total, sizeof(int), compareIds);
+    *numIds = 0;
+    for (size_t i = 0; i < total; i++) {
+        if (*numIds == 0 || ids[*numIds - 1] != ids[i]) {
+            ids[(*numIds)++] = ids[i];
+        }
+    }
+    return ids;
+}
+
+static int comparePositions(const void *a, const void *b) {
+    size_t positionA = (*(const RowChange *const *)a)->position;
+    size_t positionB = (*(const RowChange *const *)b)->position;
+    return (positionA > positionB) - (positionA < positionB);
+}
+
+/**
+ * Undoes or redoes an edit on the in-memory roster.
+ *
+ * Nothing is changed unless every row the edit touched is still exactly as
+ * the edit left it (for undo) or found it (for redo), so another user's
+ * later change to the same student is never silently overwritten.
+ * Replaced rows are copied in place, removed rows are dropped in one
+ * compacting pass and re-added rows are merged back in at their old
+ * positions from the back of the array, so a bulk edit is linear in the
+ * roster size.
+ *
+ * @param edit The edit.
+ * @param undo 1 to undo the edit, 0 to redo it.
+ * @param result Receives the roster's students after the change.
+ * @return 0 on success, HISTORY_STALE if a row has changed since, or -1 if
+ *         there is an error.
+ */
+static int applyEdit(const Edit *edit, int undo, Student **result) {
+    Student *students = loadRoster();
+    if (students == NULL) {
+        return -1;
+    }
+    size_t numStudents = countStudents(students);
+    long *rows = locateRows(students, numStudents, edit->changes, edit->numChanges);
+    if (rows == NULL) {
+        return -1;
+    }
+
+    size_t numRemoved = 0;
+    size_t numAdded = 0;
+    for (size_t c = 0; c < edit->numChanges; c++) {
+        const RowChange *change = &edit->changes[c];
+        int expected = undo ? change->existsAfter : change->existedBefore;
+        int wanted = undo ? change->existedBefore : change->existsAfter;
+        const Student *image = undo ? &change->after : &change->before;
+        if ((rows[c] != -1) != expected
+            || (expected && !isSameStudent(&students[rows[c]], image))) {
+            printf("Student %d has changed since this edit was made.\n", change->id);
+            free(rows);
+            return HISTORY_STALE;
+        }
+        numRemoved += expected && !wanted;
+        numAdded += !expected && wanted;
+    }
+
+    unsigned char *removed = calloc(numStudents + 1, 1);
+    const RowChange **added = malloc((numAdded + 1) * sizeof(RowChange *));
+    if (removed == NULL || added == NULL) {
+        perror("Error allocating memory for edit history");
+        free(rows);
+        free(removed);
+        free(added);
+        return -1;
+    }
+
+    numAdded = 0;
+    for (size_t c = 0; c < edit->numChanges; c++) {
+        const RowChange *change = &edit->changes[c];
+        int wanted = undo ? change->existedBefore : change->existsAfter;
+        if (rows[c] != -1 && wanted) {
+            students[rows[c]] = undo ? change->before : change->after;
+        } else if (rows[c] != -1) {
+            removed[rows[c]] = 1;
+        } else if (wanted) {
+            added[numAdded++] = change;
+        }
+    }
+    free(rows);
+
+    if (numRemoved > 0) {
+        size_t kept = 0;
+        for (size_t i = 0; i < numStudents; i++) {
+            if (!removed[i]) {
+                students[kept++] = students[i];
+            }
+        }
+        numStudents = kept;
+        memset(&students[numStudents], 0, sizeof(Student));
+    }
+    free(removed);
+
+    if (numAdded > 0) {
+        students = reserveRoster(numStudents + numAdded);
+        if (students == NULL) {
+            free(added);
+            return -1;
+        }
+
+        // Merge from the back: each re-added row lands at its old position,
+        // or as close to it as the rows now in front of it allow
+        qsort(added, numAdded, sizeof(RowChange *), comparePositions);
+        size_t write = numStudents + numAdded;
+        size_t read = numStudents;
+        for (size_t a = numAdded; a-- > 0;) {
+            const RowChange *change = added[a];
+            size_t position = change->position < read + a ? change->position : read + a;
+            while (write - 1 > position) {
+                students[--write] = students[--read];
+            }
+            students[--write] = undo ? change->before : change->after;
+        }
+        numStudents += numAdded;
+        memset(&students[numStudents], 0, sizeof(Student));
+    }
+    free(added);
+
+    *result = students;
+    return 0;
+}
+
+/**
+ * Frees an edit's row versions.
+ *
+ * @param edit The edit.
+ */
+static void freeEdit(Edit *edit) {
+    free(edit->changes);
+    edit->changes = NULL;
+    edit->numChanges = 0;
+}
+
+/**
+ * Pushes an edit onto a stack; the stack takes ownership of its rows.
+ *
+ * @param stack The stack.
+ * @param edit The edit.
+ * @return 0 on success, -1 if memory cannot be allocated.
+ */
+static int pushEdit(EditStack *stack, const Edit *edit) {
+    if (stack->count == stack->capacity) {
+        size_t newCapacity = stack->capacity < 16 ? 16 : stack->capacity * 2;
+        Edit *grown = realloc(stack->edits, newCapacity * sizeof(Edit));
+        if (grown == NULL) {
+            perror("Error allocating memory for edit history");
+            return -1;
+        }
+        stack->edits = grown;
+        stack->capacity = newCapacity;
+    }
+    stack->edits[stack->count++] = *edit;
+    return 0;
+}
+
+/**
+ * Forgets the oldest undo levels beyond MAX_UNDO_LEVELS.
+ *
+ * Edits made in the open transaction are never forgotten, since the
+ * commit needs them to know which students to save.
+ */
+static void trimUndoStack(void) {
+    while (undoStack.count > MAX_UNDO_LEVELS && (!transactionOpen || transactionBase > 0)) {
+        freeEdit(&undoStack.edits[0]);
+        memmove(&undoStack.edits[0], &undoStack.edits[1], (undoStack.count - 1) * sizeof(Edit));
+        undoStack.count--;
+        if (transactionOpen) {
+            transactionBase--;
+        }
+    }
+}
+
+/**
+ * Drops every edit on a stack above a given depth.
+ *
+ * @param stack The stack.
+ * @param depth The number of edits to keep.
+ */
+static void truncateStack(EditStack *stack, size_t depth) {
+    while (stack->count > depth) {
+        freeEdit(&stack->edits[--stack->count]);
+    }
+}
+
+/**
+ * Describes an edit for messages, e.g. "Delete student (student 5040)".
+ *
+ * @param edit The edit.
+ * @param buffer Where to write the description.
+ * @param bufferSize The size of the buffer.
+ */
+static void describeEdit(const Edit *edit, char *buffer, size_t bufferSize) {
+    if (edit->numChanges == 1) {
+        snprintf(buffer, bufferSize, "%s (student %d)", edit->description, edit->changes[0].id);
+    } else {
+        snprintf(buffer, bufferSize, "%s (%zu students)", edit->description, edit->numChanges);
+    }
+}
+
+/**
+ * Remembers the rows an edit is about to change.
+ *
+ * Call this before changing the students, then finishEdit once the change
+ * has been made. Only the named rows are copied, so history costs memory in
+ * proportion to what was edited rather than to the roster.
+ *
+ * @param students The roster, before the change.
+ * @param ids The IDs of the students that will be changed, added or removed;
+ *            must stay valid until finishEdit.
+ * @param numIds The number of IDs.
+ */
+void beginEdit(const Student *students, const int *ids, size_t numIds) {
+    pendingIds = ids;
+    numPendingIds = numIds;
+    pending.numChanges = 0;
+    pending.changes = calloc(numIds + 1, sizeof(RowChange));
+    if (pending.changes == NULL) {
+        perror("Error allocating memory for edit history");
+        return;
+    }
+
+    for (size_t c = 0; c < numIds; c++) {
+        pending.changes[c].id = ids[c];
+    }
+    pending.numChanges = numIds;
+
+    long *rows = locateRows(students, countStudents(students), pending.changes, numIds);
+    if (rows == NULL) {
+        freeEdit(&pending);
+        return;
+    }
+    for (size_t c = 0; c < numIds; c++) {
+        if (rows[c] != -1) {
+            pending.changes[c].existedBefore = 1;
+            pending.changes[c].before = students[rows[c]];
+            pending.changes[c].position = (size_t)rows[c];
+        }
+    }
+    free(rows);
+}
+
+/**
+ * Records the edit started by beginEdit and saves it.
+ *
+ * Outside a transaction the edit is saved right away with saveRoster and
+ * becomes the newest undo level. Inside a transaction it is only kept in
+ * memory until the transaction is committed or rolled back. Either way any
+ * edits that were undone can no longer be redone.
+ *
+ * students must be the array returned by loadRoster, with the edit already
+ * applied. It must not be used after this call.
+ *
+ * @param students The roster with the edit applied.
+ * @param description What the edit did, e.g. "Update last name".
+ * @return 0 if the edit was saved or kept for the transaction,
+ *         ROSTER_CONFLICT if it conflicted with another user's changes,
+ *         -1 if there is an error.
+ */
+int finishEdit(Student *students, const char *description) {
+    if (pending.changes != NULL) {
+        long *rows = locateRows(students, countStudents(students), pending.changes,
+                                pending.numChanges);
+        if (rows == NULL) {
+            freeEdit(&pending);
+        } else {
+            for (size_t c = 0; c < pending.numChanges; c++) {
+                if (rows[c] != -1) {
+                    pending.changes[c].existsAfter = 1;
+                    pending.changes[c].after = students[rows[c]];
+                    if (!pending.changes[c].existedBefore) {
+                        pending.changes[c].position = (size_t)rows[c];
+                    }
+                }
+            }
+            free(rows);
+            snprintf(pending.description, sizeof(pending.description), "%s", description);
+        }
+    }
+
+    int result = 0;
+    if (!transactionOpen) {
+        result = saveRoster(students, pendingIds, numPendingIds);
+    } else if (pending.changes == NULL) {
+        result = -1;  // Without its rows the commit could not save this edit
+    }
+
+    if (result == 0 && pending.changes != NULL && pushEdit(&undoStack, &pending) == 0) {
+        truncateStack(&redoStack, 0);
+        trimUndoStack();
+    } else {
+        freeEdit(&pending);
+    }
+    pending.changes = NULL;
+    pendingIds = NULL;
+    numPendingIds = 0;
+    return result;
+}
+
+/**
+ * Checks whether a transaction is open.
+ *
+ * @return 1 if a transaction is open, 0 otherwise.
+ */
+int isTransactionOpen(void) {
+    return transactionOpen;
+}
+
+/**
+ * Returns the number of edits made in the open transaction.
+ *
+ * @return The number of uncommitted edits, or 0 if no transaction is open.
+ */
+size_t transactionEditCount(void) {
+    return transactionOpen ? undoStack.count - transactionBase : 0;
+}
+
+/**
+ * Undoes or redoes the newest edit on one stack and moves it to the other.
+ *
+ * Outside a transaction the result is saved right away; inside one it is
+ * kept in memory like any other edit. An edit whose students have since
+ * been changed by someone else cannot be applied and is discarded.
+ *
+ * @param undo 1 to undo, 0 to redo.
+ */
+static void stepHistory(int undo) {
+    EditStack *from = undo ? &undoStack : &redoStack;
+    EditStack *to = undo ? &redoStack : &undoStack;
+    char description[128];
+
+    if (from->count == 0 || (undo && transactionOpen && from->count == transactionBase)) {
+        printf(undo ? (transactionOpen ? "Nothing to undo in this transaction.\n\n"
+                                       : "Nothing to undo.\n\n")
+                    : "Nothing to redo.\n\n");
+        return;
+    }
+
+    Edit *edit = &from->edits[from->count - 1];
+    describeEdit(edit, description, sizeof(description));
+
+    Student *students;
+    int result = applyEdit(edit, undo, &students);
+    if (result == HISTORY_STALE) {
+        printf("\"%s\" can no longer be %s and has been discarded.\n\n", description,
+               undo ? "undone" : "redone");
+        truncateStack(from, from->count - 1);
+        return;
+    }
+    if (result != 0) {
+        printf("Error updating the file.\n");
+        return;
+    }
+
+    if (!transactionOpen) {
+        size_t numIds;
+        int *ids = collectIds(edit, 1, &numIds);
+        if (ids == NULL) {
+            return;
+        }
+        result = saveRoster(students, ids, numIds);
+        free(ids);
+        if (result < 0) {
+            printf("Error updating the file.\n");
+        }
+        if (result != 0) {
+            return;
+        }
+    }
+
+    if (pushEdit(to, edit) != 0) {
+        freeEdit(edit);
+    }
+    from->count--;
+    if (!undo) {
+        trimUndoStack();
+    }
+    printf("%s: %s%s\n\n", undo ? "Undone" : "Redone", description,
+           transactionOpen ? " (not saved until the transaction is committed)" : "");
+}
+
+/**
+ * Undoes the most recent edit.
+ */
+void undoLastEdit(void) {
+    stepHistory(1);
+}
+
+/**
+ * Redoes the most recently undone edit.
+ */
+void redoLastEdit(void) {
+    stepHistory(0);
+}
+
+/**
+ * Forgets every undo and redo level and ends any open transaction.
+ *
+ * The edits are not undone. Call this together with resetRoster when
+ * switching to another roster file.
+ */
+void clearHistory(void) {
+    truncateStack(&undoStack, 0);
+    truncateStack(&redoStack, 0);
+    transactionOpen = 0;
+    transactionBase = 0;
+    holdRoster(0);
+}
+
+/**
+ * Starts a transaction.
+ *
+ * The roster is brought up to date and then held, so a reload can never
+ * replace edits that have not been committed.
+ */
+static void beginTransaction(void) {
+    loadRoster();
+    holdRoster(1);
+    transactionOpen = 1;
+    transactionBase = undoStack.count;
+}
+
+/**
+ * Ends the transaction and forgets its edits.
+ */
+static void discardTransaction(void) {
+    truncateStack(&undoStack, transactionBase);
+    truncateStack(&redoStack, 0);
+    transactionOpen = 0;
+    holdRoster(0);
+}
+
+/**
+ * Undoes the transaction's edits in memory, newest first.
+ *
+ * @return 0 on success, -1 if an edit could not be undone.
+ */
+static int undoTransactionEdits(void) {
+    Student *students;
+
+    while (undoStack.count > transactionBase) {
+        if (applyEdit(&undoStack.edits[undoStack.count - 1], 1, &students) != 0) {
+            return -1;
+        }
+        freeEdit(&undoStack.edits[--undoStack.count]);
+    }
+    return 0;
+}
+
+/**
+ * Saves every edit made in the transaction with a single write.
+ *
+ * The edits stay in the undo history. If they conflict with another user's
+ * changes nothing is written and the transaction's edits are dropped, just
+ * as a single conflicting edit would be. If the file cannot be written the
+ * roster is read back from it, or the edits are undone in memory if it
+ * cannot be read, so no uncommitted edit is saved by a later one.
+ */
+static void commitTransaction(void) {
+    size_t numEdits = undoStack.count - transactionBase;
+    size_t numIds;
+    int *ids = collectIds(&undoStack.edits[transactionBase], numEdits, &numIds);
+    if (ids == NULL) {
+        return;
+    }
+
+    Student *students = loadRoster();
+    int result = numIds == 0 ? 0 : saveRoster(students, ids, numIds);
+    free(ids);
+
+    if (result == 0) {
+        holdRoster(0);
+        transactionOpen = 0;
+        printf("Transaction committed: %zu edits to %zu students saved.\n\n", numEdits, numIds);
+        return;
+    }
+
+    if (result < 0) {
+        printf("Error updating the file.\n");
+
+        // Read the roster back now, or undo the edits in memory if the file cannot be read
+        unsigned long version = rosterVersion();
+        loadRoster();
+        if (rosterVersion() == version && undoTransactionEdits() != 0) {
+            printf("Error rolling back the transaction.\n");
+        }
+    }
+    printf("Transaction not committed; its edits have been discarded.\n\n");
+    discardTransaction();
+}
+
+/**
+ * Undoes every edit made in the transaction, in memory, and ends it.
+ */
+static void rollbackTransaction(void) {
+    size_t numEdits = undoStack.count - transactionBase;
+
+    // The roster is held, so nobody else can have changed these rows
+    if (undoTransactionEdits() != 0) {
+        printf("Error rolling back the transaction.\n");
+    }
+    discardTransaction();
+    printf("Transaction rolled back: %zu edits undone.\n\n", numEdits);
+}
+
+/**
+ * Begins, commits or rolls back a transaction.
+ *
+ * With no transaction open the user is asked whether to begin one. Edits
+ * made in a transaction are kept in memory until the user commits them
+ * with a single save or rolls them all back.
+ */
+void manageTransaction(void) {
+    char confirm;
+    int selection = 0;
+
+    printf("Transaction\n");
+    printf("-----------\n");
+
+    if (!transactionOpen) {
+        printf("No transaction is open; edits are saved as soon as they are made.\n\n");
+        printf("Begin a transaction? (y/n): ");
+        scanf(" %c", &confirm);
+        if (confirm == 'y' || confirm == 'Y') {
+            beginTransaction();
+            printf("Transaction started. Edits are kept in memory until you commit.\n\n");
+        }
+        return;
+    }
+
+    while (selection < 1 || selection > 3) {
+        printf("%zu uncommitted edits.\n\n", transactionEditCount());
+        printf("1. Commit\n");
+        printf("2. Roll Back\n");
+        printf("3. Keep Editing\n\n");
+        printf("Selection: ");
+        scanf("%d", &selection);
+        if (selection < 1 || selection > 3) {
+            clearInputBuffer();
+            system("clear");
+            printf("Invalid selection. Please try again.\n\n");
+        }
+    }
+
+    if (selection == 1) {
+        commitTransaction();
+    } else if (selection == 2) {
+        rollbackTransaction();
+    }
+}
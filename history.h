@@ -0,0 +1,17 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+#include <stddef.h>
+#include "student.h"
+
+// Undo levels kept outside a transaction; the oldest edit is forgotten first
+#define MAX_UNDO_LEVELS 100
+
+void beginEdit(const Student *students, const int *ids, size_t numIds);
+int finishEdit(Student *students, const char *description);
+int isTransactionOpen(void);
+size_t transactionEditCount(void);
+void undoLastEdit(void);
+void redoLastEdit(void);
+void clearHistory(void);
+void manageTransaction(void);
+#endif // HISTORY_H
@@ -1,10 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "spreadsheet.h"
+#include "server.h"
+#include "export.h"
+#include "perf.h"
+#include "history.h"
 
 /*
  * To compile use
- * gcc -o main main.c spreadsheet.c data.c
+ * gcc -o main main.c spreadsheet.c data.c collate.c sort.c query.c roster.c server.c export.c perf.c history.c -pthread
  *
  * To run use 
  * ./main
@@ -12,7 +17,15 @@
 
 void printMainMenu();
 
-int main() {
+int main(int argc, char *argv[]) {
+  perfInit();
+  if (argc > 1 && strcmp(argv[1], "export") == 0) {
+    return runExportCommand(argc, argv);
+  }
+  if (argc > 1) {
+    return runServerCommand(argc, argv);
+  }
+
   system("clear");
   int isTerminated = 0;
   while(!isTerminated) {
@@ -22,6 +35,9 @@ int main() {
 }
 
 void printMainMenu() {
+      if (isTransactionOpen()) {
+        printf("Transaction open: %zu uncommitted edits\n\n", transactionEditCount());
+      }
       printf("Spreadsheet Menu\n"
            "----------------\n"
            "1. Display Spreadsheet\n"
@@ -31,7 +47,14 @@ void printMainMenu() {
            "5. Update Exam Grade\n"
            "6. Update Grade Mapping\n"
            "7. Delete Student\n"
-           "8. Exit\n"
+           "8. Set Filter\n"
+           "9. Delete Matching Students\n"
+           "10. Export Roster\n"
+           "11. Performance Stats\n"
+           "12. Undo\n"
+           "13. Redo\n"
+           "14. Transaction\n"
+           "15. Exit\n"
            "\n");
 }
 
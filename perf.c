@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "perf.h"
+
+// Latencies are bucketed by power of two: bucket b holds [2^b, 2^(b+1)) ns
+#define PERF_BUCKETS 64
+// Counted-only probes are batched per thread and published this often
+#define PERF_COUNT_BATCH 1024
+
+// Each probe on its own cache lines so threads timing different probes never share one
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t calls;
+    atomic_uint_fast64_t totalNanoseconds;
+    atomic_uint_fast64_t maxNanoseconds;
+    atomic_uint_fast64_t buckets[PERF_BUCKETS];
+} ProbeStats;
+
+static ProbeStats probes[PERF_PROBE_COUNT];
+static atomic_uint_fast64_t counters[PERF_COUNTER_COUNT];
+static _Thread_local uint64_t pendingCounts[PERF_PROBE_COUNT];
+
+#ifndef PERF_DISABLED
+static const char *probeNames[PERF_PROBE_COUNT] = {
+    "readStudents", "parseLine", "sortOrder", "calculateTotal", "writeStudents"
+};
+#endif
+
+/**
+ * Returns the time on the monotonic clock in nanoseconds.
+ *
+ * @return The current time in nanoseconds.
+ */
+uint64_t perfNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Records the latency of one call of a probe without counting the call.
+ *
+ * @param probe The probe.
+ * @param nanoseconds How long the call took.
+ */
+void perfRecordSample(PerfProbe probe, uint64_t nanoseconds) {
+    ProbeStats *stats = &probes[probe];
+    int bucket = 63 - __builtin_clzll(nanoseconds | 1);
+
+    atomic_fetch_add_explicit(&stats->totalNanoseconds, nanoseconds, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->buckets[bucket], 1, memory_order_relaxed);
+
+    uint_fast64_t max = atomic_load_explicit(&stats->maxNanoseconds, memory_order_relaxed);
+    while (nanoseconds > max
+           && !atomic_compare_exchange_weak_explicit(&stats->maxNanoseconds, &max, nanoseconds,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+/**
+ * Records one timed call of a probe.
+ *
+ * @param probe The probe.
+ * @param nanoseconds How long the call took.
+ */
+void perfRecord(PerfProbe probe, uint64_t nanoseconds) {
+    atomic_fetch_add_explicit(&probes[probe].calls, 1, memory_order_relaxed);
+    perfRecordSample(probe, nanoseconds);
+}
+
+/**
+ * Counts one untimed call of a probe.
+ *
+ * Used for functions too cheap to time, where even an uncontended atomic
+ * add would cost more than the call. Counts collect in a per-thread total
+ * and are published every PERF_COUNT_BATCH calls, or by perfFlushThread, so
+ * other threads' counts may lag by less than one batch each when stats are
+ * printed.
+ *
+ * @param probe The probe.
+ */
+void perfCount(PerfProbe probe) {
+    if (++pendingCounts[probe] == PERF_COUNT_BATCH) {
+        atomic_fetch_add_explicit(&probes[probe].calls, PERF_COUNT_BATCH, memory_order_relaxed);
+        pendingCounts[probe] = 0;
+    }
+}
+
+/**
+ * Counts one call of a sampled probe and decides whether to time it.
+ *
+ * The first call on a thread and every PERF_SAMPLE_INTERVAL-th after it are
+ * timed, which keeps the clock reads off most calls while still filling the
+ * latency buckets.
+ *
+ * @param probe The probe.
+ * @return The start time if this call is sampled, otherwise 0.
+ */
+uint64_t perfStartSampled(PerfProbe probe) {
+    perfCount(probe);
+    return (pendingCounts[probe] - 1) % PERF_SAMPLE_INTERVAL == 0 ? perfNow() : 0;
+}
+
+/**
+ * Publishes the calling thread's batched call counts.
+ *
+ * Threads that count probes must call this before they exit, or up to one
+ * batch of calls per probe is lost with them.
+ */
+void perfFlushThread(void) {
+    for (int p = 0; p < PERF_PROBE_COUNT; p++) {
+        if (pendingCounts[p] != 0) {
+            atomic_fetch_add_explicit(&probes[p].calls, pendingCounts[p], memory_order_relaxed);
+            pendingCounts[p] = 0;
+        }
+    }
+}
+
+/**
+ * Adds to a byte counter.
+ *
+ * @param counter The counter.
+ * @param amount The amount to add.
+ */
+void perfAdd(PerfCounter counter, uint64_t amount) {
+    atomic_fetch_add_explicit(&counters[counter], amount, memory_order_relaxed);
+}
+
+#ifndef PERF_DISABLED
+/**
+ * Returns an upper bound on a latency percentile from a probe's buckets.
+ *
+ * @param stats The probe's stats.
+ * @param timedCalls The number of timed calls.
+ * @param percentile The percentile, between 0 and 100.
+ * @return The percentile latency in nanoseconds, at most the probe's maximum.
+ */
+static uint64_t percentileNanoseconds(ProbeStats *stats, uint64_t timedCalls, double percentile) {
+    uint64_t target = (uint64_t)(timedCalls * percentile / 100.0 + 0.5);
+    uint64_t max = atomic_load_explicit(&stats->maxNanoseconds, memory_order_relaxed);
+    uint64_t seen = 0;
+
+    if (target == 0) {
+        target = 1;
+    }
+    for (int b = 0; b < PERF_BUCKETS; b++) {
+        seen += atomic_load_explicit(&stats->buckets[b], memory_order_relaxed);
+        if (seen >= target) {
+            uint64_t bound = b >= 63 ? UINT64_MAX : (uint64_t)2 << b;
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+#endif
+
+/**
+ * Prints call counts, latencies and byte counts for every probe.
+ *
+ * Percentiles are read from power-of-two buckets, so each is an upper
+ * bound within a factor of two of the true value. For sampled probes the
+ * total time is estimated from the mean of the sampled calls. Probes that
+ * are only counted show no latencies.
+ *
+ * @param out The stream to print to.
+ */
+void printPerfStats(FILE *out) {
+#ifdef PERF_DISABLED
+    fprintf(out, "Performance stats were compiled out (built with -DPERF_DISABLED).\n\n");
+#else
+    perfFlushThread();  // This thread's own calls are exact
+
+    fprintf(out, "%-15s %10s %11s %10s %10s %10s %10s %10s\n",
+            "Probe", "Calls", "Total ms", "Mean us", "p50 us", "p90 us", "p99 us", "Max us");
+    fprintf(out, "%-15s %10s %11s %10s %10s %10s %10s %10s\n",
+            "---------------", "----------", "-----------", "----------",
+            "----------", "----------", "----------", "----------");
+
+    for (int p = 0; p < PERF_PROBE_COUNT; p++) {
+        ProbeStats *stats = &probes[p];
+        uint64_t calls = atomic_load_explicit(&stats->calls, memory_order_relaxed);
+        uint64_t total = atomic_load_explicit(&stats->totalNanoseconds, memory_order_relaxed);
+        uint64_t timedCalls = 0;
+        for (int b = 0; b < PERF_BUCKETS; b++) {
+            timedCalls += atomic_load_explicit(&stats->buckets[b], memory_order_relaxed);
+        }
+
+        fprintf(out, "%-15s %10llu", probeNames[p], (unsigned long long)calls);
+        if (timedCalls == 0) {
+            fprintf(out, " %11s %10s %10s %10s %10s %10s\n", "-", "-", "-", "-", "-", "-");
+            continue;
+        }
+        fprintf(out, " %11.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                total / 1e6 * (double)calls / (double)timedCalls,
+                total / 1e3 / (double)timedCalls,
+                percentileNanoseconds(stats, timedCalls, 50) / 1e3,
+                percentileNanoseconds(stats, timedCalls, 90) / 1e3,
+                percentileNanoseconds(stats, timedCalls, 99) / 1e3,
+                atomic_load_explicit(&stats->maxNanoseconds, memory_order_relaxed) / 1e3);
+    }
+
+    fprintf(out, "\nBytes read:    %llu\n",
+            (unsigned long long)atomic_load(&counters[PERF_BYTES_READ]));
+    fprintf(out, "Bytes written: %llu\n\n",
+            (unsigned long long)atomic_load(&counters[PERF_BYTES_WRITTEN]));
+#endif
+}
+
+/**
+ * Displays the performance stats collected so far in this session.
+ */
+void displayPerfStats(void) {
+    printf("Performance Stats\n");
+    printf("-----------------\n");
+    printPerfStats(stdout);
+}
+
+/**
+ * Prints the performance stats to stderr; registered with atexit.
+ */
+static void dumpPerfStats(void) {
+    fprintf(stderr, "\nPerformance Stats\n-----------------\n");
+    printPerfStats(stderr);
+}
+
+/**
+ * Arranges for the performance stats to be printed to stderr at exit if
+ * the SPREADSHEET_PERF environment variable is set to anything but "0".
+ */
+void perfInit(void) {
+    const char *setting = getenv("SPREADSHEET_PERF");
+    if (setting != NULL && *setting != '\0' && strcmp(setting, "0") != 0) {
+        atexit(dumpPerfStats);
+    }
+}
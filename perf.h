@@ -0,0 +1,53 @@
+#ifndef PERF_H
+#define PERF_H
+#include <stdio.h>
+#include <stdint.h>
+
+#define PERF_SAMPLE_INTERVAL 16
+
+// Instrumented hot paths
+typedef enum {
+    PERF_READ_STUDENTS,
+    PERF_PARSE_LINE,
+    PERF_SORT_ORDER,
+    PERF_CALCULATE_TOTAL,
+    PERF_WRITE_STUDENTS,
+    PERF_PROBE_COUNT
+} PerfProbe;
+
+typedef enum {
+    PERF_BYTES_READ,
+    PERF_BYTES_WRITTEN,
+    PERF_COUNTER_COUNT
+} PerfCounter;
+
+// Build with -DPERF_DISABLED to compile every probe out
+#ifdef PERF_DISABLED
+#define PERF_START() ((uint64_t)0)
+#define PERF_STOP(probe, start) ((void)(start))
+#define PERF_START_SAMPLED(probe) ((uint64_t)0)
+#define PERF_STOP_SAMPLED(probe, start) ((void)(start))
+#define PERF_COUNT(probe) ((void)0)
+#define PERF_ADD(counter, amount) ((void)0)
+#else
+#define PERF_START() perfNow()
+#define PERF_STOP(probe, start) perfRecord((probe), perfNow() - (start))
+// For calls too short to time every time: counts every call, times one in PERF_SAMPLE_INTERVAL
+#define PERF_START_SAMPLED(probe) perfStartSampled(probe)
+#define PERF_STOP_SAMPLED(probe, start) \
+    do { if ((start) != 0) perfRecordSample((probe), perfNow() - (start)); } while (0)
+#define PERF_COUNT(probe) perfCount(probe)
+#define PERF_ADD(counter, amount) perfAdd((counter), (amount))
+#endif
+
+uint64_t perfNow(void);
+void perfRecord(PerfProbe probe, uint64_t nanoseconds);
+void perfRecordSample(PerfProbe probe, uint64_t nanoseconds);
+uint64_t perfStartSampled(PerfProbe probe);
+void perfCount(PerfProbe probe);
+void perfFlushThread(void);
+void perfAdd(PerfCounter counter, uint64_t amount);
+void perfInit(void);
+void printPerfStats(FILE *out);
+void displayPerfStats(void);
+#endif // PERF_H
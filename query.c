@@ -0,0 +1,539 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "query.h"
+#include "collate.h"
+#include "data.h"
+#include "student.h"
+
+typedef enum {
+    TOKEN_END,
+    TOKEN_WORD,
+    TOKEN_NUMBER,
+    TOKEN_STRING,
+    TOKEN_OPERATOR,
+    TOKEN_OPEN,
+    TOKEN_CLOSE,
+    TOKEN_INVALID
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    QueryOp op;
+    float number;
+    char text[NAME_KEY_SIZE];
+} Token;
+
+typedef struct {
+    const char *p;
+    Query *query;
+    size_t depth;
+    char *error;
+    size_t errorSize;
+} Parser;
+
+typedef struct {
+    const char *name;
+    QueryField field;
+} FieldName;
+
+static const FieldName fieldNames[] = {
+    {"id", FIELD_ID},           {"last", FIELD_LAST_NAME},   {"lastname", FIELD_LAST_NAME},
+    {"first", FIELD_FIRST_NAME}, {"firstname", FIELD_FIRST_NAME},
+    {"asst1", FIELD_ASST1},     {"a1", FIELD_ASST1},         {"asst2", FIELD_ASST2},
+    {"a2", FIELD_ASST2},        {"asst3", FIELD_ASST3},      {"a3", FIELD_ASST3},
+    {"midterm", FIELD_MIDTERM}, {"final", FIELD_FINAL},      {"exam", FIELD_FINAL},
+    {"total", FIELD_TOTAL},     {"grade", FIELD_GRADE},
+};
+
+static int parseOr(Parser *parser);
+
+/**
+ * Ranks a letter grade so that better grades rank higher (A = 4, F = 0).
+ *
+ * @param grade The letter grade.
+ * @return The rank, or -1 if the letter is not a grade.
+ */
+static int gradeRank(char grade) {
+    switch (toupper((unsigned char)grade)) {
+        case 'A': return 4;
+        case 'B': return 3;
+        case 'C': return 2;
+        case 'D': return 1;
+        case 'F': return 0;
+        default: return -1;
+    }
+}
+
+/**
+ * Records a compile error at the parser's current position.
+ *
+ * @param parser The parser.
+ * @param message The error message.
+ * @return -1, for convenience.
+ */
+static int fail(Parser *parser, const char *message) {
+    snprintf(parser->error, parser->errorSize, "%s near \"%.20s\"", message, parser->p);
+    return -1;
+}
+
+/**
+ * Reads the next token from the query text.
+ *
+ * @param parser The parser.
+ * @param token The token that receives what was read.
+ */
+static void nextToken(Parser *parser, Token *token) {
+    const char *p = parser->p;
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+
+    token->text[0] = '\0';
+    if (*p == '\0') {
+        token->type = TOKEN_END;
+    } else if (*p == '(' || *p == ')') {
+        token->type = *p == '(' ? TOKEN_OPEN : TOKEN_CLOSE;
+        p++;
+    } else if (strchr("<>=!", *p) != NULL) {
+        token->type = TOKEN_OPERATOR;
+        if (p[0] == '<') {
+            token->op = p[1] == '=' ? OP_LE : OP_LT;
+        } else if (p[0] == '>') {
+            token->op = p[1] == '=' ? OP_GE : OP_GT;
+        } else if (p[0] == '=') {
+            token->op = OP_EQ;
+        } else if (p[1] == '=') {
+            token->op = OP_NE;
+        } else {
+            token->type = TOKEN_INVALID;
+        }
+        p += (p[1] == '=') ? 2 : 1;
+    } else if (isdigit((unsigned char)*p) || *p == '.' || *p == '-') {
+        char *end;
+        token->number = strtof(p, &end);
+        token->type = end == p ? TOKEN_INVALID : TOKEN_NUMBER;
+        p = end == p ? p + 1 : end;
+    } else if (*p == '\'' || *p == '"') {
+        char quote = *p++;
+        size_t length = 0;
+        while (*p != '\0' && *p != quote) {
+            if (length + 1 < sizeof(token->text)) {
+                token->text[length++] = *p;
+            }
+            p++;
+        }
+        token->text[length] = '\0';
+        token->type = *p == quote ? TOKEN_STRING : TOKEN_INVALID;
+        if (*p == quote) {
+            p++;
+        }
+    } else if (isalpha((unsigned char)*p) || (unsigned char)*p >= 0x80) {
+        size_t length = 0;
+        while (isalnum((unsigned char)*p) || *p == '_' || *p == '\'' || *p == '-'
+               || (unsigned char)*p >= 0x80) {
+            if (length + 1 < sizeof(token->text)) {
+                token->text[length++] = *p;
+            }
+            p++;
+        }
+        token->text[length] = '\0';
+        token->type = TOKEN_WORD;
+    } else {
+        token->type = TOKEN_INVALID;
+        p++;
+    }
+
+    parser->p = p;
+}
+
+/**
+ * Reads the next token without consuming it.
+ *
+ * @param parser The parser.
+ * @param token The token that receives what was read.
+ */
+static void peekToken(Parser *parser, Token *token) {
+    const char *saved = parser->p;
+    nextToken(parser, token);
+    parser->p = saved;
+}
+
+/**
+ * Appends a step to the compiled query and tracks the mask stack depth.
+ *
+ * @param parser The parser.
+ * @param step The step to append.
+ * @return 0 on success, -1 if the query has too many steps.
+ */
+static int emit(Parser *parser, const QueryStep *step) {
+    Query *query = parser->query;
+    if (query->count == MAX_QUERY_STEPS) {
+        return fail(parser, "Query is too long");
+    }
+
+    query->steps[query->count++] = *step;
+    if (step->kind == STEP_COMPARE) {
+        parser->depth++;
+        if (parser->depth > query->depth) {
+            query->depth = parser->depth;
+        }
+    } else if (step->kind != STEP_NOT) {
+        parser->depth--;
+    }
+    return 0;
+}
+
+/**
+ * Parses a comparison such as "final < 20", "grade = F" or "last = Smith".
+ *
+ * @param parser The parser.
+ * @return 0 on success, -1 on error.
+ */
+static int parseComparison(Parser *parser) {
+    Token token;
+    QueryStep step = {STEP_COMPARE, FIELD_ID, OP_EQ, 0.0f, ""};
+    size_t i;
+
+    nextToken(parser, &token);
+    if (token.type != TOKEN_WORD) {
+        return fail(parser, "Expected a column name");
+    }
+    for (i = 0; i < sizeof(fieldNames) / sizeof(fieldNames[0]); i++) {
+        if (strcasecmp(token.text, fieldNames[i].name) == 0) {
+            break;
+        }
+    }
+    if (i == sizeof(fieldNames) / sizeof(fieldNames[0])) {
+        return fail(parser, "Unknown column");
+    }
+    step.field = fieldNames[i].field;
+
+    nextToken(parser, &token);
+    if (token.type != TOKEN_OPERATOR) {
+        return fail(parser, "Expected a comparison operator");
+    }
+    step.op = token.op;
+
+    nextToken(parser, &token);
+    if (step.field == FIELD_LAST_NAME || step.field == FIELD_FIRST_NAME) {
+        if (token.type != TOKEN_WORD && token.type != TOKEN_STRING) {
+            return fail(parser, "Expected a name");
+        }
+        foldName(token.text, step.name, sizeof(step.name));
+    } else if (step.field == FIELD_GRADE) {
+        if (token.type != TOKEN_WORD || strlen(token.text) != 1 || gradeRank(token.text[0]) < 0) {
+            return fail(parser, "Expected a letter grade (A, B, C, D or F)");
+        }
+        step.number = (float)gradeRank(token.text[0]);
+    } else {
+        if (token.type != TOKEN_NUMBER) {
+            return fail(parser, "Expected a number");
+        }
+        step.number = token.number;
+    }
+
+    return emit(parser, &step);
+}
+
+/**
+ * Parses "not" factors, parenthesized expressions and comparisons.
+ *
+ * @param parser The parser.
+ * @return 0 on success, -1 on error.
+ */
+static int parseFactor(Parser *parser) {
+    Token token;
+    peekToken(parser, &token);
+
+    if (token.type == TOKEN_WORD && strcasecmp(token.text, "not") == 0) {
+        QueryStep step = {STEP_NOT, FIELD_ID, OP_EQ, 0.0f, ""};
+        nextToken(parser, &token);
+        if (parseFactor(parser) != 0) {
+            return -1;
+        }
+        return emit(parser, &step);
+    }
+
+    if (token.type == TOKEN_OPEN) {
+        nextToken(parser, &token);
+        if (parseOr(parser) != 0) {
+            return -1;
+        }
+        nextToken(parser, &token);
+        if (token.type != TOKEN_CLOSE) {
+            return fail(parser, "Expected ')'");
+        }
+        return 0;
+    }
+
+    return parseComparison(parser);
+}
+
+/**
+ * Parses factors joined by "and".
+ *
+ * @param parser The parser.
+ * @return 0 on success, -1 on error.
+ */
+static int parseAnd(Parser *parser) {
+    QueryStep step = {STEP_AND, FIELD_ID, OP_EQ, 0.0f, ""};
+    Token token;
+
+    if (parseFactor(parser) != 0) {
+        return -1;
+    }
+    peekToken(parser, &token);
+    while (token.type == TOKEN_WORD && strcasecmp(token.text, "and") == 0) {
+        nextToken(parser, &token);
+        if (parseFactor(parser) != 0 || emit(parser, &step) != 0) {
+            return -1;
+        }
+        peekToken(parser, &token);
+    }
+    return 0;
+}
+
+/**
+ * Parses terms joined by "or".
+ *
+ * @param parser The parser.
+ * @return 0 on success, -1 on error.
+ */
+static int parseOr(Parser *parser) {
+    QueryStep step = {STEP_OR, FIELD_ID, OP_EQ, 0.0f, ""};
+    Token token;
+
+    if (parseAnd(parser) != 0) {
+        return -1;
+    }
+    peekToken(parser, &token);
+    while (token.type == TOKEN_WORD && strcasecmp(token.text, "or") == 0) {
+        nextToken(parser, &token);
+        if (parseAnd(parser) != 0 || emit(parser, &step) != 0) {
+            return -1;
+        }
+        peekToken(parser, &token);
+    }
+    return 0;
+}
+
+/**
+ * Compiles a query expression into a postfix program.
+ *
+ * The query language compares columns against constants and combines the
+ * comparisons with "and", "or", "not" and parentheses, for example
+ * "final < 20 and grade = F" or "asst1 >= 30 or not (total > 50)".
+ *
+ * Columns are id, last, first, asst1/a1, asst2/a2, asst3/a3, midterm,
+ * final/exam, total and grade. Names compare case- and accent-insensitively.
+ * Grades compare by rank, so "grade >= B" matches A and B.
+ *
+ * @param text The query text.
+ * @param query The query to fill in.
+ * @param error A buffer that receives a message if the text is invalid.
+ * @param errorSize The size of the error buffer.
+ * @return 0 if the query compiled, -1 otherwise.
+ */
+int compileQuery(const char *text, Query *query, char *error, size_t errorSize) {
+    Parser parser = {text, query, 0, error, errorSize};
+    Token token;
+
+    query->count = 0;
+    query->depth = 0;
+    snprintf(query->text, sizeof(query->text), "%s", text);
+
+    if (parseOr(&parser) != 0) {
+        return -1;
+    }
+    nextToken(&parser, &token);
+    if (token.type != TOKEN_END) {
+        return fail(&parser, "Unexpected text");
+    }
+    return 0;
+}
+
+/**
+ * Extracts one numeric column of the roster into a flat array.
+ *
+ * @param field The column to extract.
+ * @param students Pointer to the array of Student structs.
+ * @param numStudents The number of students.
+ * @param values The array that receives one value per student.
+ */
+static void loadColumn(QueryField field, const Student *students, size_t numStudents,
+                       float *values) {
+    switch (field) {
+        case FIELD_ID:
+            for (size_t i = 0; i < numStudents; i++) values[i] = (float)students[i].id;
+            break;
+        case FIELD_ASST1:
+            for (size_t i = 0; i < numStudents; i++) values[i] = (float)students[i].asst1;
+            break;
+        case FIELD_ASST2:
+            for (size_t i = 0; i < numStudents; i++) values[i] = (float)students[i].asst2;
+            break;
+        case FIELD_ASST3:
+            for (size_t i = 0; i < numStudents; i++) values[i] = (float)students[i].asst3;
+            break;
+        case FIELD_MIDTERM:
+            for (size_t i = 0; i < numStudents; i++) values[i] = (float)students[i].midterm;
+            break;
+        case FIELD_FINAL:
+            for (size_t i = 0; i < numStudents; i++) values[i] = (float)students[i].final;
+            break;
+        case FIELD_TOTAL:
+            for (size_t i = 0; i < numStudents; i++) values[i] = calculateTotal(students[i]);
+            break;
+        case FIELD_GRADE:
+            for (size_t i = 0; i < numStudents; i++) {
+                values[i] = (float)gradeRank(calculateGrade(calculateTotal(students[i])));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Compares a flat column against a constant, one match flag per student.
+ *
+ * Each operator gets its own branch-free loop so the compiler can vectorize it.
+ *
+ * @param values The column values.
+ * @param numStudents The number of values.
+ * @param op The comparison operator.
+ * @param number The constant to compare against.
+ * @param matches The flags to fill in.
+ */
+static void compareColumn(const float *values, size_t numStudents, QueryOp op, float number,
+                          unsigned char *matches) {
+    switch (op) {
+        case OP_LT:
+            for (size_t i = 0; i < numStudents; i++) matches[i] = values[i] < number;
+            break;
+        case OP_LE:
+            for (size_t i = 0; i < numStudents; i++) matches[i] = values[i] <= number;
+            break;
+        case OP_GT:
+            for (size_t i = 0; i < numStudents; i++) matches[i] = values[i] > number;
+            break;
+        case OP_GE:
+            for (size_t i = 0; i < numStudents; i++) matches[i] = values[i] >= number;
+            break;
+        case OP_EQ:
+            for (size_t i = 0; i < numStudents; i++) matches[i] = values[i] == number;
+            break;
+        case OP_NE:
+            for (size_t i = 0; i < numStudents; i++) matches[i] = values[i] != number;
+            break;
+    }
+}
+
+/**
+ * Compares a name column against a folded name, one match flag per student.
+ *
+ * @param step The comparison step.
+ * @param students Pointer to the array of Student structs.
+ * @param numStudents The number of students.
+ * @param matches The flags to fill in.
+ */
+static void compareNames(const QueryStep *step, const Student *students, size_t numStudents,
+                         unsigned char *matches) {
+    char key[NAME_KEY_SIZE];
+
+    for (size_t i = 0; i < numStudents; i++) {
+        const char *name = step->field == FIELD_LAST_NAME ? students[i].lastName
+                                                          : students[i].firstName;
+        foldName(name, key, sizeof(key));
+        int order = strcmp(key, step->name);
+
+        switch (step->op) {
+            case OP_LT: matches[i] = order < 0; break;
+            case OP_LE: matches[i] = order <= 0; break;
+            case OP_GT: matches[i] = order > 0; break;
+            case OP_GE: matches[i] = order >= 0; break;
+            case OP_EQ: matches[i] = order == 0; break;
+            case OP_NE: matches[i] = order != 0; break;
+        }
+    }
+}
+
+/**
+ * Evaluates a compiled query over the roster.
+ *
+ * The program runs a column at a time rather than a row at a time: each
+ * comparison fills a whole mask of match flags and "and", "or" and "not"
+ * combine whole masks, so every inner loop is a simple pass over flat arrays.
+ *
+ * If memory cannot be allocated no student matches.
+ *
+ * @param query The compiled query.
+ * @param students Pointer to the array of Student structs.
+ * @param numStudents The number of students.
+ * @param matches Receives 1 for each matching student and 0 otherwise.
+ * @return The number of matching students.
+ */
+size_t evaluateQuery(const Query *query, const Student *students, size_t numStudents,
+                     unsigned char *matches) {
+    if (numStudents == 0) {
+        return 0;
+    }
+    if (query->count == 0) {
+        memset(matches, 1, numStudents);
+        return numStudents;
+    }
+
+    unsigned char *masks = malloc(query->depth * numStudents);
+    float *values = malloc(numStudents * sizeof(float));
+    if (masks == NULL || values == NULL) {
+        perror("Error allocating memory for query");
+        free(masks);
+        free(values);
+        memset(matches, 0, numStudents);
+        return 0;
+    }
+
+    size_t top = 0;
+    for (size_t s = 0; s < query->count; s++) {
+        const QueryStep *step = &query->steps[s];
+        unsigned char *mask = masks + (top - (step->kind == STEP_COMPARE ? 0 : 1)) * numStudents;
+
+        switch (step->kind) {
+            case STEP_COMPARE:
+                if (step->field == FIELD_LAST_NAME || step->field == FIELD_FIRST_NAME) {
+                    compareNames(step, students, numStudents, mask);
+                } else {
+                    loadColumn(step->field, students, numStudents, values);
+                    compareColumn(values, numStudents, step->op, step->number, mask);
+                }
+                top++;
+                break;
+            case STEP_AND:
+                mask -= numStudents;
+                for (size_t i = 0; i < numStudents; i++) mask[i] &= mask[i + numStudents];
+                top--;
+                break;
+            case STEP_OR:
+                mask -= numStudents;
+                for (size_t i = 0; i < numStudents; i++) mask[i] |= mask[i + numStudents];
+                top--;
+                break;
+            case STEP_NOT:
+                for (size_t i = 0; i < numStudents; i++) mask[i] ^= 1;
+                break;
+        }
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < numStudents; i++) {
+        matches[i] = masks[i];
+        count += masks[i];
+    }
+
+    free(masks);
+    free(values);
+    return count;
+}
@@ -0,0 +1,46 @@
+#ifndef QUERY_H
+#define QUERY_H
+#include <stddef.h>
+#include "student.h"
+#include "collate.h"
+
+#define MAX_QUERY_STEPS 32
+#define MAX_QUERY_LENGTH 256
+
+typedef enum {
+    FIELD_ID,
+    FIELD_LAST_NAME,
+    FIELD_FIRST_NAME,
+    FIELD_ASST1,
+    FIELD_ASST2,
+    FIELD_ASST3,
+    FIELD_MIDTERM,
+    FIELD_FINAL,
+    FIELD_TOTAL,
+    FIELD_GRADE
+} QueryField;
+
+typedef enum { OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE } QueryOp;
+
+typedef enum { STEP_COMPARE, STEP_AND, STEP_OR, STEP_NOT } QueryStepKind;
+
+// One instruction of a compiled query, in postfix order
+typedef struct {
+    QueryStepKind kind;
+    QueryField field;
+    QueryOp op;
+    float number;               // Numeric fields; grades hold their rank
+    char name[NAME_KEY_SIZE];   // Name fields, folded like the sort keys
+} QueryStep;
+
+typedef struct {
+    QueryStep steps[MAX_QUERY_STEPS];
+    size_t count;
+    size_t depth;  // Most match masks alive at once while evaluating
+    char text[MAX_QUERY_LENGTH];
+} Query;
+
+int compileQuery(const char *text, Query *query, char *error, size_t errorSize);
+size_t evaluateQuery(const Query *query, const Student *students, size_t numStudents,
+                     unsigned char *matches);
+#endif // QUERY_H
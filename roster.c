@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "roster.h"
+#include "data.h"
+#include "student.h"
+
+// Prefixes are re-hashed in chunks of this size before an incremental reload
+#define HASH_CHUNK 65536
+
+// The in-memory roster and what the file looked like when it was last synced
+typedef struct {
+    Student *students;
+    size_t count;
+    size_t capacity;
+    Student *baseline;      // Rows as on disk at the last sync, to spot conflicts
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    uint64_t hash;          // hashBytes of the file contents at the last sync
+    unsigned long version;  // Bumped on every sync
+    int loaded;
+    int held;               // Set while uncommitted edits must not be reloaded over
+} Roster;
+
+static Roster roster;
+
+/**
+ * Folds bytes into a running FNV-1a hash.
+ *
+ * @param hash The running hash, starting at ROSTER_HASH_SEED.
+ * @param bytes The bytes to fold in.
+ * @param length The number of bytes.
+ * @return The updated hash.
+ */
+uint64_t hashBytes(uint64_t hash, const char *bytes, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * Checks whether a file is exactly the one the roster was last synced with.
+ *
+ * @param info The file's current status.
+ * @return 1 if the device, inode, size and modification time all match.
+ */
+static int isUnchanged(const struct stat *info) {
+    return roster.loaded
+           && info->st_dev == roster.device
+           && info->st_ino == roster.inode
+           && info->st_size == roster.size
+           && info->st_mtim.tv_sec == roster.modified.tv_sec
+           && info->st_mtim.tv_nsec == roster.modified.tv_nsec;
+}
+
+/**
+ * Records the file status and the rows the roster is now in sync with.
+ *
+ * @param info The file's status right after the last read or write.
+ */
+static void markSynced(const struct stat *info) {
+    roster.device = info->st_dev;
+    roster.inode = info->st_ino;
+    roster.size = info->st_size;
+    roster.modified = info->st_mtim;
+    roster.loaded = 1;
+    roster.version++;
+
+    Student *baseline = realloc(roster.baseline, (roster.count + 1) * sizeof(Student));
+    if (baseline == NULL) {
+        perror("Error allocating memory for roster baseline");
+        return;
+    }
+    memcpy(baseline, roster.students, (roster.count + 1) * sizeof(Student));
+    roster.baseline = baseline;
+}
+
+/**
+ * Replaces the in-memory students with another array.
+ *
+ * @param students The new array, terminated by ID 0.
+ * @param count The number of students in it.
+ * @param capacity The number of Student slots allocated.
+ */
+static void replaceStudents(Student *students, size_t count, size_t capacity) {
+    if (roster.students != students) {
+        free(roster.students);
+    }
+    roster.students = students;
+    roster.count = count;
+    roster.capacity = capacity;
+}
+
+/**
+ * Appends only the rows added to the end of the file since the last sync.
+ *
+ * This is only possible when the file is the same inode, has grown, ended
+ * with a newline and still starts with exactly the bytes last synced, which
+ * is checked by re-hashing that prefix (much cheaper than parsing it).
+ *
+ * @param file The file, locked for reading.
+ * @param info The file's current status.
+ * @return 0 if the new rows were appended, -1 if a full reload is needed.
+ */
+static int appendNewRows(FILE *file, const struct stat *info) {
+    if (!roster.loaded || info->st_dev != roster.device || info->st_ino != roster.inode
+        || info->st_size <= roster.size || roster.size == 0) {
+        return -1;
+    }
+
+    char *chunk = malloc(HASH_CHUNK);
+    if (chunk == NULL) {
+        return -1;
+    }
+
+    uint64_t hash = ROSTER_HASH_SEED;
+    off_t remaining = roster.size;
+    char lastByte = '\0';
+    while (remaining > 0) {
+        size_t wanted = remaining < HASH_CHUNK ? (size_t)remaining : HASH_CHUNK;
+        size_t got = fread(chunk, 1, wanted, file);
+        if (got != wanted) {
+            break;
+        }
+        hash = hashBytes(hash, chunk, got);
+        lastByte = chunk[got - 1];
+        remaining -= (off_t)got;
+    }
+    free(chunk);
+
+    if (remaining != 0 || hash != roster.hash || lastByte != '\n') {
+        return -1;
+    }
+    return readStudents(file, &roster.students, &roster.count, &roster.capacity, &roster.hash);
+}
+
+/**
+ * Reads the whole file into a fresh array of students.
+ *
+ * @param file The file, locked and positioned at its start.
+ * @param hash Receives the hash of the file contents.
+ * @param count Receives the number of students.
+ * @param capacity Receives the number of Student slots allocated.
+ * @return The students, or NULL if memory cannot be allocated.
+ */
+static Student *readAllRows(FILE *file, uint64_t *hash, size_t *count, size_t *capacity) {
+    Student *students = NULL;
+    *hash = ROSTER_HASH_SEED;
+    *count = 0;
+    *capacity = 0;
+
+    if (readStudents(file, &students, count, capacity, hash) != 0) {
+        free(students);
+        return NULL;
+    }
+    return students;
+}
+
+/**
+ * Returns the roster, reading the file only if it changed.
+ *
+ * The file's device, inode, size and modification time are compared with
+ * the last sync, so an unchanged file costs one stat call. When another
+ * process only appended rows, just the new rows are parsed; any other change
+ * reloads the whole file. The file is read under a shared lock.
+ *
+ * While the roster is held (see holdRoster) the in-memory students are
+ * returned without looking at the file. A reload prints a note to stderr.
+ *
+ * The returned array is owned by the roster. It stays valid until the next
+ * call to loadRoster, saveRoster or reserveRoster.
+ *
+ * @return The students terminated by ID 0, or NULL if the file cannot be read.
+ */
+Student *loadRoster(void) {
+    struct stat info;
+    if (roster.loaded && roster.held) {
+        return roster.students;
+    }
+    if (roster.loaded && stat(rosterFileName, &info) == 0 && isUnchanged(&info)) {
+        return roster.students;
+    }
+
+    FILE *file = fopen(rosterFileName, "r");
+    if (file == NULL) {
+        perror("Error opening file");
+        return roster.students;
+    }
+    flock(fileno(file), LOCK_SH);
+    fstat(fileno(file), &info);
+
+    int wasLoaded = roster.loaded;
+    if (appendNewRows(file, &info) != 0) {
+        uint64_t hash;
+        size_t count, capacity;
+        rewind(file);
+        Student *students = readAllRows(file, &hash, &count, &capacity);
+        if (students == NULL) {
+            fclose(file);
+            return roster.students;
+        }
+        replaceStudents(students, count, capacity);
+        roster.hash = hash;
+    }
+    markSynced(&info);
+    fclose(file);  // Closing the file releases the lock
+
+    // To stderr: the server and the benchmarks use stdout for their output
+    if (wasLoaded) {
+        fprintf(stderr, "Note: %s was changed by another user and has been reloaded.\n\n",
+                rosterFileName);
+    }
+    return roster.students;
+}
+
+/**
+ * Returns a number that changes every time the roster is read or saved.
+ *
+ * Callers that keep their own copy of the students can compare it with the
+ * value they saw last to tell whether loadRoster returned new data.
+ *
+ * @return The roster version.
+ */
+unsigned long rosterVersion(void) {
+    return roster.version;
+}
+
+/**
+ * Holds or releases the in-memory roster.
+ *
+ * While held, loadRoster never reloads the file, so edits that have not been
+ * saved yet are not replaced by another user's changes. Those changes are
+ * picked up, merged or reported as conflicts by the next saveRoster.
+ *
+ * @param held 1 to hold the roster, 0 to release it.
+ */
+void holdRoster(int held) {
+    roster.held = held;
+}
+
+/**
+ * Forgets the in-memory roster.
+ *
+ * The next loadRoster reads the file in full, as on the first call, without
+ * a reload note. Call this before pointing rosterFileName at another file.
+ */
+void resetRoster(void) {
+    unsigned long version = roster.version;  // Stays increasing for rosterVersion callers
+
+    free(roster.students);
+    free(roster.baseline);
+    roster = (Roster){0};
+    roster.version = version;
+}
+
+/**
+ * Makes room in the roster for a number of students.
+ *
+ * @param numStudents The number of students the array must be able to hold,
+ *                    not counting the terminating ID 0.
+ * @return The roster's students, possibly moved, or NULL if memory cannot be
+ *         allocated.
+ */
+Student *reserveRoster(size_t numStudents) {
+    if (numStudents + 1 > roster.capacity) {
+        Student *grown = realloc(roster.students, (numStudents + 1) * sizeof(Student));
+        if (grown == NULL) {
+            perror("Error allocating memory for students array");
+            return NULL;
+        }
+        roster.students = grown;
+        roster.capacity = numStudents + 1;
+    }
+    return roster.students;
+}
+
+/**
+ * Finds a student by ID.
+ *
+ * @param students An array of Student structures terminated by ID 0, or NULL.
+ * @param studentID The ID to look for.
+ * @return The student's index, or -1 if there is no such student.
+ */
+long findStudent(const Student *students, int studentID) {
+    if (students == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; students[i].id != 0; i++) {
+        if (students[i].id == studentID) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Checks whether two rows hold the same data.
+ *
+ * @param a The first student.
+ * @param b The second student.
+ * @return 1 if every field is equal, 0 otherwise.
+ */
+int isSameStudent(const Student *a, const Student *b) {
+    return a->id == b->id
+           && strcmp(a->lastName, b->lastName) == 0
+           && strcmp(a->firstName, b->firstName) == 0
+           && a->asst1 == b->asst1
+           && a->asst2 == b->asst2
+           && a->asst3 == b->asst3
+           && a->midterm == b->midterm
+           && a->final == b->final;
+}
+
+/**
+ * Reports edited students that another user changed since the last sync.
+ *
+ * A student conflicts when its row on disk differs from the row this
+ * instance last read, including when one of the two no longer exists.
+ *
+ * @param disk The students currently on disk.
+ * @param editedIds The IDs of the students being edited.
+ * @param numEdited The number of IDs.
+ * @return The number of conflicting students.
+ */
+static size_t reportConflicts(const Student *disk, const int *editedIds, size_t numEdited) {
+    size_t conflicts = 0;
+
+    for (size_t e = 0; e < numEdited; e++) {
+        long before = findStudent(roster.baseline, editedIds[e]);
+        long now = findStudent(disk, editedIds[e]);
+        if (before == -1 && now == -1) {
+            continue;
+        }
+        if (before != -1 && now != -1 && isSameStudent(&roster.baseline[before], &disk[now])) {
+            continue;
+        }
+
+        if (conflicts == 0) {
+            printf("Conflict: %s was changed by another user.\n", rosterFileName);
+        }
+        conflicts++;
+
+        if (now == -1) {
+            printf("  Student %d was deleted.\n", editedIds[e]);
+        } else if (before == -1) {
+            printf("  Student %d was added.\n", editedIds[e]);
+        } else {
+            const Student *s = &disk[now];
+            printf("  Student %d is now: %s, %s  %d %d %d %d %d\n", s->id, s->lastName,
+                   s->firstName, s->asst1, s->asst2, s->asst3, s->midterm, s->final);
+        }
+    }
+    return conflicts;
+}
+
+/**
+ * Applies edited students on top of the students on disk.
+ *
+ * Each edited ID takes its row from the local students; an ID that is no
+ * longer present locally is removed.
+ *
+ * @param disk The students on disk; may be reallocated.
+ * @param count The number of students on disk, updated on return.
+ * @param capacity The number of Student slots allocated, updated on return.
+ * @param students The local students.
+ * @param editedIds The IDs of the edited students.
+ * @param numEdited The number of IDs.
+ * @return 0 on success, -1 if memory cannot be allocated.
+ */
+static int mergeEdits(Student **disk, size_t *count, size_t *capacity, const Student *students,
+                      const int *editedIds, size_t numEdited) {
+    for (size_t e = 0; e < numEdited; e++) {
+        long local = findStudent(students, editedIds[e]);
+        long onDisk = findStudent(*disk, editedIds[e]);
+
+        if (local != -1 && onDisk != -1) {
+            (*disk)[onDisk] = students[local];
+        } else if (local != -1) {
+            if (*count + 2 > *capacity) {
+                Student *grown = realloc(*disk, (*capacity * 2 + 2) * sizeof(Student));
+                if (grown == NULL) {
+                    perror("Error allocating memory for students array");
+                    return -1;
+                }
+                *disk = grown;
+                *capacity = *capacity * 2 + 2;
+            }
+            (*disk)[(*count)++] = students[local];
+            memset(&(*disk)[*count], 0, sizeof(Student));
+        } else if (onDisk != -1) {
+            memmove(&(*disk)[onDisk], &(*disk)[onDisk + 1],
+                    (*count - (size_t)onDisk) * sizeof(Student));
+            (*count)--;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Saves edited students to the file.
+ *
+ * The file is locked exclusively for the whole check-and-write. If no one
+ * else changed it since the last sync, the students are written as they are.
+ * Otherwise the current file is read back: if any edited student was also
+ * changed there, a conflict report is printed, nothing is written and the
+ * roster is reloaded from the file; if not, the edits are merged into the
+ * current file contents so the other user's changes are kept.
+ *
+ * students must be the array returned by loadRoster, with the edits already
+ * applied. It must not be used after this call. If the save fails the edits
+ * are dropped: the next loadRoster reads the file again in full.
+ *
+ * @param students The roster with the edits applied.
+ * @param editedIds The IDs of the students that were changed, added or removed.
+ * @param numEdited The number of IDs.
+ * @return 0 if the edits were saved, ROSTER_CONFLICT if they conflicted with
+ *         another user's changes, -1 if there is an error.
+ */
+int saveRoster(Student *students, const int *editedIds, size_t numEdited) {
+    roster.count = 0;
+    while (students[roster.count].id != 0) {
+        roster.count++;
+    }
+
+    int fd = open(rosterFileName, O_RDWR | O_CREAT, 0644);
+    FILE *file = fd == -1 ? NULL : fdopen(fd, "r+");
+    if (file == NULL) {
+        perror("Error opening file for writing");
+        if (fd != -1) {
+            close(fd);
+        }
+        roster.loaded = 0;  // Drop the unsaved edit: force a full reload
+        return -1;
+    }
+    flock(fd, LOCK_EX);
+
+    struct stat info;
+    fstat(fd, &info);
+    if (!isUnchanged(&info)) {
+        uint64_t hash;
+        size_t count, capacity;
+        Student *disk = readAllRows(file, &hash, &count, &capacity);
+        if (disk == NULL) {
+            fclose(file);
+            roster.loaded = 0;  // Drop the unsaved edit: force a full reload
+            return -1;
+        }
+
+        if (reportConflicts(disk, editedIds, numEdited) > 0) {
+            printf("Your change was not saved; the spreadsheet has been reloaded.\n\n");
+            replaceStudents(disk, count, capacity);
+            roster.hash = hash;
+            markSynced(&info);
+            fclose(file);
+            return ROSTER_CONFLICT;
+        }
+
+        if (mergeEdits(&disk, &count, &capacity, students, editedIds, numEdited) != 0) {
+            free(disk);
+            fclose(file);
+            roster.loaded = 0;  // Drop the unsaved edit: force a full reload
+            return -1;
+        }
+        replaceStudents(disk, count, capacity);
+    }
+
+    uint64_t hash = ROSTER_HASH_SEED;
+    rewind(file);
+    int result = ftruncate(fd, 0) == 0 ? writeStudents(file, roster.students, &hash) : -1;
+    if (result == 0) {
+        roster.hash = hash;
+        fstat(fd, &info);
+        markSynced(&info);
+    } else {
+        roster.loaded = 0;  // Unknown file contents: force a full reload
+    }
+
+    fclose(file);  // Closing the file releases the lock
+    return result;
+}
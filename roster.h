@@ -0,0 +1,21 @@
+#ifndef ROSTER_H
+#define ROSTER_H
+#include <stddef.h>
+#include <stdint.h>
+#include "student.h"
+
+#define ROSTER_HASH_SEED 0xcbf29ce484222325ULL
+
+// saveRoster result when another user changed a student being edited
+#define ROSTER_CONFLICT 1
+
+uint64_t hashBytes(uint64_t hash, const char *bytes, size_t length);
+Student *loadRoster(void);
+unsigned long rosterVersion(void);
+int saveRoster(Student *students, const int *editedIds, size_t numEdited);
+void holdRoster(int held);
+void resetRoster(void);
+Student *reserveRoster(size_t numStudents);
+long findStudent(const Student *students, int studentID);
+int isSameStudent(const Student *a, const Student *b);
+#endif // ROSTER_H
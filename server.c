@@ -0,0 +1,969 @@
+#define _GNU_SOURCE  // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "server.h"
+#include "data.h"
+#include "perf.h"
+#include "query.h"
+#include "roster.h"
+#include "sort.h"
+#include "student.h"
+
+#define SERVER_THREADS 4
+#define MAX_EVENTS 64
+#define MAX_REQUEST 512
+#define RELOAD_INTERVAL_MS 200
+#define MAX_TOP 1000
+// Requests are left unanswered while this much output waits for the client
+#define MAX_PENDING_OUTPUT (256 * 1024)
+
+// An immutable copy of the roster shared by every reader
+typedef struct {
+    Student *students;
+    size_t count;
+    size_t *byId;  // Student indexes in ID order, for lookups
+} Snapshot;
+
+// One client connection, owned by the thread whose epoll instance holds it
+typedef struct {
+    int fd;
+    char input[MAX_REQUEST];
+    size_t inputLength;
+    char *output;
+    size_t outputLength;
+    size_t outputCapacity;
+    size_t outputSent;
+    int closing;
+} Connection;
+
+// One load generator client and the latencies it measured
+typedef struct {
+    const char *socketPath;
+    const char *command;
+    int numRequests;
+    double *latencies;
+    int failures;
+} LoadClient;
+
+static Snapshot *currentSnapshot;
+static pthread_rwlock_t snapshotLock;  // Writer-preferring; set up by runServer
+static volatile sig_atomic_t stopping = 0;
+
+/**
+ * Asks the server threads to stop after their current wait.
+ *
+ * @param signalNumber The signal received.
+ */
+static void requestStop(int signalNumber) {
+    (void)signalNumber;
+    stopping = 1;
+}
+
+/**
+ * Returns the time on the monotonic clock in seconds.
+ *
+ * @return The current time in seconds.
+ */
+static double monotonicSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**
+ * Frees a snapshot and everything it owns.
+ *
+ * @param snapshot The snapshot, or NULL.
+ */
+static void freeSnapshot(Snapshot *snapshot) {
+    if (snapshot != NULL) {
+        free(snapshot->students);
+        free(snapshot->byId);
+        free(snapshot);
+    }
+}
+
+/**
+ * Publishes a copy of the roster as the snapshot readers see.
+ *
+ * The copy and its ID index are built before taking the lock, so readers
+ * are only held up for the pointer swap. Taking the write lock also waits
+ * for readers still using the old snapshot, which can then be freed.
+ *
+ * @param students The roster, terminated by ID 0.
+ * @return 0 on success, -1 if memory cannot be allocated.
+ */
+static int publishSnapshot(const Student *students) {
+    static const SortSpec idOrder = {{{SORT_ID, 0}}, 1};
+    Snapshot *snapshot = calloc(1, sizeof(Snapshot));
+    if (snapshot == NULL) {
+        return -1;
+    }
+
+    while (students[snapshot->count].id != 0) {
+        snapshot->count++;
+    }
+    snapshot->students = malloc((snapshot->count + 1) * sizeof(Student));
+    if (snapshot->students == NULL) {
+        freeSnapshot(snapshot);
+        return -1;
+    }
+    memcpy(snapshot->students, students, (snapshot->count + 1) * sizeof(Student));
+    snapshot->byId = sortOrder(snapshot->students, snapshot->count, &idOrder);
+    if (snapshot->byId == NULL) {
+        freeSnapshot(snapshot);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&snapshotLock);
+    Snapshot *old = currentSnapshot;
+    currentSnapshot = snapshot;
+    pthread_rwlock_unlock(&snapshotLock);
+
+    freeSnapshot(old);
+    return 0;
+}
+
+/**
+ * Watches the roster file and republishes the snapshot when it changes.
+ *
+ * loadRoster only reads the file when its status changed, so polling it is
+ * one stat call per interval while nothing happens.
+ *
+ * @param arg Unused.
+ * @return NULL.
+ */
+static void *watchRoster(void *arg) {
+    (void)arg;
+    unsigned long version = rosterVersion();
+    struct timespec interval = {0, RELOAD_INTERVAL_MS * 1000000L};
+
+    while (!stopping) {
+        nanosleep(&interval, NULL);
+        Student *students = loadRoster();
+        if (students != NULL && rosterVersion() != version) {
+            version = rosterVersion();
+            if (publishSnapshot(students) != 0) {
+                perror("Error publishing roster snapshot");
+            }
+            fflush(stdout);
+        }
+    }
+    perfFlushThread();
+    return NULL;
+}
+
+/**
+ * Finds a student in a snapshot by ID using its ID index.
+ *
+ * @param snapshot The snapshot to search.
+ * @param studentID The ID to look for.
+ * @return The student, or NULL if there is no such student.
+ */
+static const Student *lookupStudent(const Snapshot *snapshot, int studentID) {
+    size_t low = 0;
+    size_t high = snapshot->count;
+
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        const Student *student = &snapshot->students[snapshot->byId[mid]];
+        if (student->id < studentID) {
+            low = mid + 1;
+        } else if (student->id > studentID) {
+            high = mid;
+        } else {
+            return student;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Splits a "where <query>" clause off the end of a command's arguments.
+ *
+ * @param args The arguments; the clause is cut off in place.
+ * @param filter Receives the compiled query, or an empty query if none.
+ * @param out The stream to print a compile error to.
+ * @return 0 on success, -1 if the query does not compile.
+ */
+static int takeWhereClause(char *args, Query *filter, FILE *out) {
+    char error[128];
+    char *where = args;
+
+    filter->count = 0;
+    filter->depth = 0;
+    filter->text[0] = '\0';
+    while ((where = strstr(where, "where")) != NULL) {
+        if ((where == args || where[-1] == ' ') && (where[5] == ' ' || where[5] == '\0')) {
+            break;
+        }
+        where++;
+    }
+    if (where == NULL) {
+        return 0;
+    }
+
+    *where = '\0';
+    where += 5 + strspn(where + 5, " ");
+    if (compileQuery(where, filter, error, sizeof(error)) != 0) {
+        fprintf(out, "ERROR Invalid filter: %s\n", error);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Runs one request against a snapshot.
+ *
+ * Requests are single lines:
+ *   display [sort <columns>] [where <query>]
+ *   histogram [where <query>]
+ *   lookup <id>
+ *   top <k>
+ *   quit
+ *
+ * @param out The stream the response is printed to.
+ * @param snapshot The snapshot to read.
+ * @param request The request line; modified while parsing.
+ * @return 1 if the client asked to close the connection, 0 otherwise.
+ */
+static int executeRequest(FILE *out, const Snapshot *snapshot, char *request) {
+    char *args = request + strcspn(request, " ");
+    if (*args != '\0') {
+        *args++ = '\0';
+    }
+
+    if (strcasecmp(request, "display") == 0) {
+        SortSpec spec = {{{SORT_ID, 0}}, 1};
+        Query filter;
+        if (takeWhereClause(args, &filter, out) != 0) {
+            return 0;
+        }
+        args += strspn(args, " ");
+        if (strncasecmp(args, "sort", 4) == 0 && parseSortSpec(args + 4, &spec) != 0) {
+            fprintf(out, "ERROR Invalid sort columns\n");
+            return 0;
+        }
+        printSpreadSheet(out, snapshot->students, snapshot->count, &spec, &filter);
+    } else if (strcasecmp(request, "histogram") == 0) {
+        Query filter;
+        if (takeWhereClause(args, &filter, out) == 0) {
+            printGradeDistribution(out, snapshot->students, snapshot->count, &filter);
+        }
+    } else if (strcasecmp(request, "lookup") == 0) {
+        const Student *student = lookupStudent(snapshot, atoi(args));
+        if (student == NULL) {
+            fprintf(out, "ERROR Student ID %d not found\n", atoi(args));
+        } else {
+            printTableHeader(out);
+            printStudentRow(out, student);
+        }
+    } else if (strcasecmp(request, "top") == 0) {
+        int k = atoi(args);
+        size_t indexes[MAX_TOP];
+        if (k < 1 || k > MAX_TOP) {
+            fprintf(out, "ERROR top expects a count from 1 to %d\n", MAX_TOP);
+            return 0;
+        }
+        size_t found = topByTotal(snapshot->students, snapshot->count, (size_t)k, indexes);
+        printTableHeader(out);
+        for (size_t i = 0; i < found; i++) {
+            printStudentRow(out, &snapshot->students[indexes[i]]);
+        }
+    } else if (strcasecmp(request, "quit") == 0) {
+        return 1;
+    } else {
+        fprintf(out, "ERROR Unknown command \"%s\"\n", request);
+    }
+    return 0;
+}
+
+/**
+ * Appends bytes to a connection's pending output.
+ *
+ * @param connection The connection.
+ * @param bytes The bytes to append.
+ * @param length The number of bytes.
+ * @return 0 on success, -1 if memory cannot be allocated.
+ */
+static int queueOutput(Connection *connection, const char *bytes, size_t length) {
+    if (connection->outputLength + length > connection->outputCapacity) {
+        size_t capacity = connection->outputCapacity * 2;
+        if (capacity < connection->outputLength + length) {
+            capacity = connection->outputLength + length;
+        }
+        char *grown = realloc(connection->output, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        connection->output = grown;
+        connection->outputCapacity = capacity;
+    }
+    memcpy(connection->output + connection->outputLength, bytes, length);
+    connection->outputLength += length;
+    return 0;
+}
+
+/**
+ * Answers one request line and queues the response.
+ *
+ * The response is formatted under the read lock, so any number of requests
+ * run at once while a reload only waits for the pointer swap. Every
+ * response ends with a line holding a single ".".
+ *
+ * @param connection The connection the request came from.
+ * @param request The request line.
+ */
+static void handleRequest(Connection *connection, char *request) {
+    char *response = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&response, &length);
+    if (out == NULL) {
+        connection->closing = 1;
+        return;
+    }
+
+    pthread_rwlock_rdlock(&snapshotLock);
+    connection->closing = executeRequest(out, currentSnapshot, request);
+    pthread_rwlock_unlock(&snapshotLock);
+
+    fputs(".\n", out);
+    fclose(out);
+    if (queueOutput(connection, response, length) != 0) {
+        connection->closing = 1;
+    }
+    free(response);
+}
+
+/**
+ * Answers the complete request lines held in a connection's input.
+ *
+ * Stops once MAX_PENDING_OUTPUT bytes of responses are queued; the remaining
+ * lines stay in the input until the client has read what is already queued,
+ * so a client that never reads cannot make the server buffer unbounded
+ * responses.
+ *
+ * @param connection The connection.
+ */
+static void answerRequests(Connection *connection) {
+    char *line = connection->input;
+    char *newline;
+    while (!connection->closing && connection->outputLength < MAX_PENDING_OUTPUT
+           && (newline = memchr(line, '\n', connection->inputLength
+                                            - (size_t)(line - connection->input))) != NULL) {
+        *newline = '\0';
+        if (newline > line && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        handleRequest(connection, line);
+        line = newline + 1;
+    }
+
+    connection->inputLength -= (size_t)(line - connection->input);
+    memmove(connection->input, line, connection->inputLength);
+}
+
+/**
+ * Checks whether a connection's input holds a complete request line.
+ *
+ * @param connection The connection.
+ * @return 1 if a request is waiting to be answered, 0 otherwise.
+ */
+static int hasRequest(const Connection *connection) {
+    return memchr(connection->input, '\n', connection->inputLength) != NULL;
+}
+
+/**
+ * Reads what the client sent and answers complete request lines.
+ *
+ * Reading stops while MAX_PENDING_OUTPUT bytes of responses are queued.
+ *
+ * @param connection The connection.
+ * @return 0 to keep the connection, -1 if it was closed or failed.
+ */
+static int readRequests(Connection *connection) {
+    while (!connection->closing && connection->outputLength < MAX_PENDING_OUTPUT) {
+        ssize_t got = read(connection->fd, connection->input + connection->inputLength,
+                           sizeof(connection->input) - connection->inputLength);
+        if (got == 0) {
+            return -1;
+        }
+        if (got < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        connection->inputLength += (size_t)got;
+
+        answerRequests(connection);
+        if (connection->inputLength == sizeof(connection->input) && !hasRequest(connection)) {
+            return -1;  // Request line too long
+        }
+    }
+    return 0;
+}
+
+/**
+ * Sends as much pending output as the socket accepts.
+ *
+ * @param connection The connection.
+ * @return 0 on success, -1 if the connection failed.
+ */
+static int flushOutput(Connection *connection) {
+    while (connection->outputSent < connection->outputLength) {
+        ssize_t sent = send(connection->fd, connection->output + connection->outputSent,
+                            connection->outputLength - connection->outputSent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        connection->outputSent += (size_t)sent;
+    }
+    connection->outputLength = 0;
+    connection->outputSent = 0;
+    return 0;
+}
+
+/**
+ * Closes a connection and frees it.
+ *
+ * @param connection The connection.
+ */
+static void closeConnection(Connection *connection) {
+    close(connection->fd);
+    free(connection->output);
+    free(connection);
+}
+
+/**
+ * Accepts every pending client and adds it to a thread's epoll instance.
+ *
+ * @param listener The listening socket.
+ * @param epollFd The thread's epoll instance.
+ */
+static void acceptClients(int listener, int epollFd) {
+    int fd;
+    while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        Connection *connection = calloc(1, sizeof(Connection));
+        struct epoll_event event = {EPOLLIN, {.ptr = connection}};
+        if (connection == NULL || epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(connection);
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+    }
+}
+
+/**
+ * Runs one server thread's event loop.
+ *
+ * Every thread has its own epoll instance and shares the listening socket
+ * (registered with EPOLLEXCLUSIVE so one thread wakes per new client). A
+ * thread serves the clients it accepted for their whole life, so connection
+ * state needs no locking; only the snapshot is shared.
+ *
+ * @param arg Pointer to the listening socket.
+ * @return NULL.
+ */
+static void *serveClients(void *arg) {
+    int listener = *(int *)arg;
+    struct epoll_event events[MAX_EVENTS];
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listen = {EPOLLIN | EPOLLEXCLUSIVE, {.ptr = NULL}};
+    if (epollFd == -1 || epoll_ctl(epollFd, EPOLL_CTL_ADD, listener, &listen) != 0) {
+        perror("Error creating event loop");
+        return NULL;
+    }
+
+    while (!stopping) {
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, 500);
+        for (int i = 0; i < ready; i++) {
+            Connection *connection = events[i].data.ptr;
+            if (connection == NULL) {
+                acceptClients(listener, epollFd);
+                continue;
+            }
+
+            int failed = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0
+                         && (events[i].events & EPOLLIN) == 0;
+            if (!failed && (events[i].events & EPOLLIN)) {
+                failed = readRequests(connection) != 0;
+            }
+            if (!failed) {
+                failed = flushOutput(connection) != 0;
+            }
+            // Answer requests held back while output was pending, now that it has drained
+            while (!failed && !connection->closing && connection->outputLength == 0
+                   && hasRequest(connection)) {
+                answerRequests(connection);
+                failed = flushOutput(connection) != 0;
+            }
+
+            int pending = connection->outputLength > 0;
+            if (failed || (connection->closing && !pending)) {
+                closeConnection(connection);
+                continue;
+            }
+
+            // Stop reading while output is pending; the client must read before sending more
+            struct epoll_event event = {pending ? EPOLLOUT : EPOLLIN, {.ptr = connection}};
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+        }
+    }
+
+    close(epollFd);
+    perfFlushThread();
+    return NULL;
+}
+
+/**
+ * Opens a Unix domain socket at a path.
+ *
+ * @param socketPath The socket path.
+ * @param address Receives the socket address.
+ * @return The socket, or -1 on error.
+ */
+static int openSocket(const char *socketPath, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", socketPath);
+        return -1;
+    }
+    strcpy(address->sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Error creating socket");
+    }
+    return fd;
+}
+
+/**
+ * Removes a socket left behind by a server that is no longer running.
+ *
+ * A path that is not a socket, or a socket that a server still answers on,
+ * is left alone, so a mistyped path or a second server cannot destroy a
+ * file or take over a running server's socket.
+ *
+ * @param socketPath The socket path.
+ * @param address The socket's address, as filled in by openSocket.
+ * @return 0 if the path is free to bind, -1 otherwise.
+ */
+static int removeStaleSocket(const char *socketPath, const struct sockaddr_un *address) {
+    struct stat info;
+    if (lstat(socketPath, &info) != 0) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        perror("Error checking socket path");
+        return -1;
+    }
+    if (!S_ISSOCK(info.st_mode)) {
+        fprintf(stderr, "%s exists and is not a socket; not replacing it\n", socketPath);
+        return -1;
+    }
+
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe == -1) {
+        perror("Error creating socket");
+        return -1;
+    }
+    int connected = connect(probe, (const struct sockaddr *)address, sizeof(*address)) == 0;
+    int error = errno;
+    close(probe);
+
+    if (connected) {
+        fprintf(stderr, "A server is already running on %s\n", socketPath);
+        return -1;
+    }
+    if (error != ECONNREFUSED) {
+        fprintf(stderr, "Cannot tell whether %s is in use: %s\n", socketPath, strerror(error));
+        return -1;
+    }
+    if (unlink(socketPath) != 0) {
+        perror("Error removing stale socket");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Serves read-only queries over the roster to many clients at once.
+ *
+ * The roster is loaded once and published as a shared snapshot. A watcher
+ * thread republishes it whenever students.txt changes (e.g. when a TA saves
+ * an edit from the menu), and SERVER_THREADS event loops answer requests
+ * from clients connected to the Unix domain socket. The server runs until
+ * it receives SIGINT or SIGTERM.
+ *
+ * @param socketPath The socket path to listen on.
+ * @return 0 on a clean shutdown, 1 on error.
+ */
+int runServer(const char *socketPath) {
+    struct sockaddr_un address;
+    pthread_t threads[SERVER_THREADS];
+    pthread_t watcher;
+    pthread_rwlockattr_t lockAttributes;
+
+    // glibc rwlocks prefer readers by default, so a steady stream of large
+    // responses could hold off a reload forever; let a waiting swap go first
+    pthread_rwlockattr_init(&lockAttributes);
+    pthread_rwlockattr_setkind_np(&lockAttributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&snapshotLock, &lockAttributes);
+    pthread_rwlockattr_destroy(&lockAttributes);
+
+    Student *students = loadRoster();
+    if (students == NULL || publishSnapshot(students) != 0) {
+        fprintf(stderr, "Error loading %s\n", rosterFileName);
+        return 1;
+    }
+
+    int listener = openSocket(socketPath, &address);
+    if (listener == -1) {
+        return 1;
+    }
+    if (removeStaleSocket(socketPath, &address) != 0) {
+        close(listener);
+        return 1;
+    }
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0
+        || listen(listener, 128) != 0) {
+        perror("Error listening on socket");
+        close(listener);
+        return 1;
+    }
+    if (fcntl(listener, F_SETFL, O_NONBLOCK) != 0) {
+        perror("Error configuring socket");
+        close(listener);
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestStop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Serving %zu students from %s on %s\n", currentSnapshot->count, rosterFileName,
+           socketPath);
+    fflush(stdout);
+
+    int numStarted = 0;
+    int error = pthread_create(&watcher, NULL, watchRoster, NULL);
+    int watching = error == 0;
+    while (error == 0 && numStarted < SERVER_THREADS) {
+        error = pthread_create(&threads[numStarted], NULL, serveClients, &listener);
+        if (error == 0) {
+            numStarted++;
+        }
+    }
+    if (error != 0) {
+        // Stop the threads that did start rather than serve with some missing
+        fprintf(stderr, "Error starting server thread: %s\n", strerror(error));
+        stopping = 1;
+    }
+
+    for (int i = 0; i < numStarted; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (watching) {
+        pthread_join(watcher, NULL);
+    }
+
+    close(listener);
+    unlink(socketPath);
+    freeSnapshot(currentSnapshot);
+    currentSnapshot = NULL;
+    pthread_rwlock_destroy(&snapshotLock);
+    printf("Server stopped\n");
+    return error != 0;
+}
+
+/**
+ * Connects to the server.
+ *
+ * @param socketPath The server's socket path.
+ * @return The connected socket, or -1 on error.
+ */
+static int connectToServer(const char *socketPath) {
+    struct sockaddr_un address;
+    int fd = openSocket(socketPath, &address);
+    if (fd != -1 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        perror("Error connecting to server");
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/**
+ * Sends a request and reads the whole response.
+ *
+ * @param fd The connected socket.
+ * @param request The request line, without the newline.
+ * @param response A growable buffer that receives the response without its
+ *                 terminating "." line; may point to NULL.
+ * @param capacity The buffer's capacity, updated if it grows.
+ * @return The length of the response, or -1 on error.
+ */
+static ssize_t sendRequest(int fd, const char *request, char **response, size_t *capacity) {
+    size_t requestLength = strlen(request);
+    if (send(fd, request, requestLength, MSG_NOSIGNAL) != (ssize_t)requestLength
+        || send(fd, "\n", 1, MSG_NOSIGNAL) != 1) {
+        return -1;
+    }
+
+    size_t length = 0;
+    for (;;) {
+        if (length + 4096 > *capacity) {
+            size_t grown = *capacity < 4096 ? 8192 : *capacity * 2;
+            char *buffer = realloc(*response, grown);
+            if (buffer == NULL) {
+                return -1;
+            }
+            *response = buffer;
+            *capacity = grown;
+        }
+
+        ssize_t got = recv(fd, *response + length, *capacity - length, 0);
+        if (got <= 0) {
+            return -1;
+        }
+        length += (size_t)got;
+
+        // Responses end with a line holding a single "."
+        char *end = *response + length;
+        if (length >= 2 && end[-2] == '.' && end[-1] == '\n'
+            && (length == 2 || end[-3] == '\n')) {
+            return (ssize_t)(length - 2);
+        }
+    }
+}
+
+/**
+ * Sends one request to the server and prints the response.
+ *
+ * @param socketPath The server's socket path.
+ * @param command The request line.
+ * @return 0 on success, 1 on error or if the server answered with an error.
+ */
+int runClient(const char *socketPath, const char *command) {
+    char *response = NULL;
+    size_t capacity = 0;
+
+    int fd = connectToServer(socketPath);
+    if (fd == -1) {
+        return 1;
+    }
+
+    ssize_t length = sendRequest(fd, command, &response, &capacity);
+    close(fd);
+    if (length < 0) {
+        fprintf(stderr, "Error reading response from server\n");
+        free(response);
+        return 1;
+    }
+
+    fwrite(response, 1, (size_t)length, stdout);
+    int failed = length >= 6 && strncmp(response, "ERROR ", 6) == 0;
+    free(response);
+    return failed;
+}
+
+/**
+ * Runs one load generator client: connects once and sends its requests.
+ *
+ * @param arg The client's LoadClient.
+ * @return NULL.
+ */
+static void *runLoadClient(void *arg) {
+    LoadClient *client = arg;
+    char *response = NULL;
+    size_t capacity = 0;
+
+    int fd = connectToServer(client->socketPath);
+    for (int i = 0; i < client->numRequests; i++) {
+        double start = monotonicSeconds();
+        if (fd == -1 || sendRequest(fd, client->command, &response, &capacity) < 0) {
+            client->failures += client->numRequests - i;
+            break;
+        }
+        client->latencies[i] = monotonicSeconds() - start;
+    }
+
+    if (fd != -1) {
+        close(fd);
+    }
+    free(response);
+    return NULL;
+}
+
+/**
+ * Compares two latencies, for qsort.
+ *
+ * @param a a pointer to the first latency
+ * @param b a pointer to the second latency
+ * @return a negative value, zero or a positive value as a is less than,
+ *         equal to or greater than b.
+ */
+static int compareLatencies(const void *a, const void *b) {
+    double latencyA = *(const double *)a;
+    double latencyB = *(const double *)b;
+    return (latencyA > latencyB) - (latencyA < latencyB);
+}
+
+/**
+ * Measures the server's throughput and latency under concurrent load.
+ *
+ * numClients threads each open one connection and send numRequests copies
+ * of the command back to back. The throughput and the latency percentiles
+ * over every request are printed at the end.
+ *
+ * @param socketPath The server's socket path.
+ * @param numClients The number of concurrent clients.
+ * @param numRequests The number of requests each client sends.
+ * @param command The request line to send.
+ * @return 0 if every request succeeded, 1 otherwise.
+ */
+int runLoadGenerator(const char *socketPath, int numClients, int numRequests,
+                     const char *command) {
+    size_t total = (size_t)numClients * (size_t)numRequests;
+    LoadClient *clients = calloc((size_t)numClients, sizeof(LoadClient));
+    pthread_t *threads = calloc((size_t)numClients, sizeof(pthread_t));
+    double *latencies = calloc(total + 1, sizeof(double));
+    if (clients == NULL || threads == NULL || latencies == NULL) {
+        perror("Error allocating memory for load generator");
+        free(clients);
+        free(threads);
+        free(latencies);
+        return 1;
+    }
+
+    double start = monotonicSeconds();
+    for (int i = 0; i < numClients; i++) {
+        clients[i].socketPath = socketPath;
+        clients[i].command = command;
+        clients[i].numRequests = numRequests;
+        clients[i].latencies = latencies + (size_t)i * (size_t)numRequests;
+    }
+    int numStarted = 0;
+    while (numStarted < numClients) {
+        int error = pthread_create(&threads[numStarted], NULL, runLoadClient,
+                                   &clients[numStarted]);
+        if (error != 0) {
+            // Clients that could not start count as failed requests
+            fprintf(stderr, "Error starting load client: %s\n", strerror(error));
+            break;
+        }
+        numStarted++;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < numClients; i++) {
+        if (i < numStarted) {
+            pthread_join(threads[i], NULL);
+        } else {
+            clients[i].failures = numRequests;
+        }
+        failures += clients[i].failures;
+    }
+    double elapsed = monotonicSeconds() - start;
+
+    // Failed requests keep a zero latency; sort them out of the way
+    qsort(latencies, total, sizeof(double), compareLatencies);
+    size_t succeeded = total - (size_t)failures;
+    double *measured = latencies + failures;
+
+    printf("Load test: %d clients x %d requests of \"%s\"\n", numClients, numRequests, command);
+    printf("Requests:    %zu (%d failed)\n", total, failures);
+    printf("Elapsed:     %.3f s\n", elapsed);
+    printf("Throughput:  %.0f requests/s\n", elapsed > 0 ? (double)succeeded / elapsed : 0.0);
+    if (succeeded > 0) {
+        printf("Latency:     p50 %.3f ms  p95 %.3f ms  p99 %.3f ms  max %.3f ms\n",
+               measured[succeeded / 2] * 1e3,
+               measured[succeeded * 95 / 100] * 1e3,
+               measured[succeeded * 99 / 100] * 1e3,
+               measured[succeeded - 1] * 1e3);
+    }
+
+    free(clients);
+    free(threads);
+    free(latencies);
+    return failures > 0;
+}
+
+/**
+ * Prints how to run the server, client and load generator.
+ *
+ * @param program The program name.
+ */
+static void printUsage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s                                 run the spreadsheet menu\n"
+            "       %s serve [-s socket]               serve queries over a socket\n"
+            "       %s client [-s socket] <request>    send one request\n"
+            "       %s loadgen [-s socket] [clients] [requests] [request]\n"
+            "       %s export <csv|jsonl> <file> [where <query>]\n"
+            "\n"
+            "Requests: display [sort <columns>] [where <query>], histogram [where <query>],\n"
+            "          lookup <id>, top <k>\n",
+            program, program, program, program, program);
+}
+
+/**
+ * Runs the server, client or load generator named on the command line.
+ *
+ * @param argc The argument count.
+ * @param argv The arguments; argv[1] names the mode.
+ * @return The process exit status.
+ */
+int runServerCommand(int argc, char *argv[]) {
+    const char *socketPath = DEFAULT_SOCKET_PATH;
+    int first = 2;
+
+    if (argc > 3 && strcmp(argv[2], "-s") == 0) {
+        socketPath = argv[3];
+        first = 4;
+    }
+
+    if (strcmp(argv[1], "serve") == 0) {
+        return runServer(argc > first ? argv[first] : socketPath);
+    }
+
+    if (strcmp(argv[1], "client") == 0 && argc > first) {
+        char request[MAX_REQUEST];
+        size_t length = 0;
+        request[0] = '\0';
+        for (int i = first; i < argc && length < sizeof(request); i++) {
+            length += (size_t)snprintf(request + length, sizeof(request) - length, "%s%s",
+                                       i == first ? "" : " ", argv[i]);
+        }
+        return runClient(socketPath, request);
+    }
+
+    if (strcmp(argv[1], "loadgen") == 0) {
+        int numClients = argc > first ? atoi(argv[first]) : 8;
+        int numRequests = argc > first + 1 ? atoi(argv[first + 1]) : 1000;
+        const char *command = argc > first + 2 ? argv[first + 2] : "top 10";
+        if (numClients < 1 || numRequests < 1) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return runLoadGenerator(socketPath, numClients, numRequests, command);
+    }
+
+    printUsage(argv[0]);
+    return 1;
+}
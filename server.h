@@ -0,0 +1,11 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#define DEFAULT_SOCKET_PATH "spreadsheet.sock"
+
+int runServer(const char *socketPath);
+int runClient(const char *socketPath, const char *command);
+int runLoadGenerator(const char *socketPath, int numClients, int numRequests,
+                     const char *command);
+int runServerCommand(int argc, char *argv[]);
+#endif // SERVER_H
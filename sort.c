@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "sort.h"
+#include "collate.h"
+#include "data.h"
+#include "perf.h"
+#include "student.h"
+
+// Runs shorter than this are insertion sorted before merging
+#define INSERTION_RUN 16
+
+// One row of the composite key table
+typedef struct {
+    uint64_t prefix;
+    const unsigned char *key;
+    size_t index;
+} SortEntry;
+
+// A student's total, kept next to its row index while ranking
+typedef struct {
+    float total;
+    size_t index;
+} RankedStudent;
+
+static const char *columnNames[] = {
+    NULL, "Student ID", "Last name", "Exam", "Total",
+    "First name", "Assignment 1", "Assignment 2", "Assignment 3", "Midterm"
+};
+
+/**
+ * Returns the width in bytes of a column's slot in the composite key.
+ *
+ * @param column The column to measure.
+ * @return The slot width in bytes.
+ */
+static size_t keyWidth(SortColumn column) {
+    switch (column) {
+        case SORT_LAST_NAME:
+            return COLLATION_KEY_SIZE;
+        case SORT_FIRST_NAME:
+            return NAME_KEY_SIZE;
+        default:
+            return sizeof(uint32_t);
+    }
+}
+
+/**
+ * Returns the direction a column sorts in when none is given.
+ *
+ * Exam and total sort best-first, as they always have; every other column
+ * sorts ascending.
+ *
+ * @param column The column to look up.
+ * @return 1 if the column sorts descending by default, 0 otherwise.
+ */
+static int defaultDescending(SortColumn column) {
+    return column == SORT_EXAM || column == SORT_TOTAL;
+}
+
+/**
+ * Stores a 32-bit value big-endian so that memcmp orders it like an integer.
+ *
+ * @param value The value to store.
+ * @param slot The four byte slot to fill.
+ */
+static void packUint32(uint32_t value, unsigned char *slot) {
+    slot[0] = (unsigned char)(value >> 24);
+    slot[1] = (unsigned char)(value >> 16);
+    slot[2] = (unsigned char)(value >> 8);
+    slot[3] = (unsigned char)value;
+}
+
+/**
+ * Encodes an integer so that its bytes compare in signed order.
+ *
+ * @param value The value to encode.
+ * @param slot The four byte slot to fill.
+ */
+static void packInt(int value, unsigned char *slot) {
+    packUint32((uint32_t)value ^ 0x80000000u, slot);
+}
+
+/**
+ * Encodes a float so that its bytes compare in numeric order.
+ *
+ * Positive values have their sign bit set and negative values have every bit
+ * flipped, which turns the IEEE 754 layout into an unsigned ordering.
+ *
+ * @param value The value to encode.
+ * @param slot The four byte slot to fill.
+ */
+static void packFloat(float value, unsigned char *slot) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits = (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+    packUint32(bits, slot);
+}
+
+/**
+ * Writes one student's slot for a sort key into the composite key.
+ *
+ * Descending keys are stored with every byte inverted so the whole composite
+ * key can still be compared with a single ascending memcmp.
+ *
+ * @param student The student to encode.
+ * @param sortKey The sort key to encode.
+ * @param slot The slot to fill, keyWidth(sortKey->column) bytes long.
+ */
+static void packKey(const Student *student, const SortKey *sortKey, unsigned char *slot) {
+    size_t width = keyWidth(sortKey->column);
+
+    switch (sortKey->column) {
+        case SORT_ID:
+            packInt(student->id, slot);
+            break;
+        case SORT_LAST_NAME:
+            buildCollationKey(student, (char *)slot);
+            break;
+        case SORT_EXAM:
+            packInt(student->final, slot);
+            break;
+        case SORT_TOTAL:
+            packFloat(calculateTotal(*student), slot);
+            break;
+        case SORT_FIRST_NAME:
+            foldName(student->firstName, (char *)slot, NAME_KEY_SIZE);
+            break;
+        case SORT_ASST1:
+            packInt(student->asst1, slot);
+            break;
+        case SORT_ASST2:
+            packInt(student->asst2, slot);
+            break;
+        case SORT_ASST3:
+            packInt(student->asst3, slot);
+            break;
+        case SORT_MIDTERM:
+            packInt(student->midterm, slot);
+            break;
+    }
+
+    if (sortKey->descending) {
+        for (size_t i = 0; i < width; i++) {
+            slot[i] = (unsigned char)~slot[i];
+        }
+    }
+}
+
+/**
+ * Compares two entries by their composite keys.
+ *
+ * @param a The first entry.
+ * @param b The second entry.
+ * @param tailWidth The number of key bytes after the packed prefix.
+ * @return A negative value, zero or a positive value as a sorts before, equal
+ *         to or after b.
+ */
+static int compareEntries(const SortEntry *a, const SortEntry *b, size_t tailWidth) {
+    if (a->prefix != b->prefix) {
+        return a->prefix < b->prefix ? -1 : 1;
+    }
+    return tailWidth == 0 ? 0 : memcmp(a->key + 8, b->key + 8, tailWidth);
+}
+
+/**
+ * Sorts entries with a stable merge sort.
+ *
+ * Short runs are insertion sorted in place, then runs are merged bottom-up,
+ * alternating between the entries and the scratch buffer. Equal entries
+ * never pass each other, so rows with equal keys keep their roster order.
+ *
+ * @param entries The entries to sort.
+ * @param scratch A buffer with room for numEntries entries.
+ * @param numEntries The number of entries.
+ * @param tailWidth The number of key bytes after the packed prefix.
+ */
+static void mergeSortEntries(SortEntry *entries, SortEntry *scratch, size_t numEntries,
+                             size_t tailWidth) {
+    for (size_t start = 0; start < numEntries; start += INSERTION_RUN) {
+        size_t end = start + INSERTION_RUN < numEntries ? start + INSERTION_RUN : numEntries;
+        for (size_t i = start + 1; i < end; i++) {
+            SortEntry entry = entries[i];
+            size_t j = i;
+            while (j > start && compareEntries(&entries[j - 1], &entry, tailWidth) > 0) {
+                entries[j] = entries[j - 1];
+                j--;
+            }
+            entries[j] = entry;
+        }
+    }
+
+    SortEntry *source = entries;
+    SortEntry *target = scratch;
+    for (size_t run = INSERTION_RUN; run < numEntries; run *= 2) {
+        for (size_t start = 0; start < numEntries; start += 2 * run) {
+            size_t middle = start + run < numEntries ? start + run : numEntries;
+            size_t end = start + 2 * run < numEntries ? start + 2 * run : numEntries;
+            size_t left = start, right = middle, out = start;
+
+            while (left < middle && right < end) {
+                if (compareEntries(&source[right], &source[left], tailWidth) < 0) {
+                    target[out++] = source[right++];
+                } else {
+                    target[out++] = source[left++];
+                }
+            }
+            while (left < middle) {
+                target[out++] = source[left++];
+            }
+            while (right < end) {
+                target[out++] = source[right++];
+            }
+        }
+
+        SortEntry *swap = source;
+        source = target;
+        target = swap;
+    }
+
+    if (source != entries) {
+        memcpy(entries, source, numEntries * sizeof(SortEntry));
+    }
+}
+
+/**
+ * Computes the order students appear in under a sort specification.
+ *
+ * One composite key is packed per student, holding every sort key's slot
+ * back to back, so comparing two rows is a single memcmp no matter how many
+ * keys there are. The first eight bytes of each key are also packed into an
+ * integer that settles most comparisons on its own. The sort is stable: rows
+ * that tie on every key stay in roster order.
+ *
+ * @param students Pointer to the array of Student structs.
+ * @param numStudents The number of students in the array.
+ * @param spec The sort keys in priority order.
+ * @return A newly allocated array of numStudents indexes in sorted order, or
+ *         NULL if memory cannot be allocated. The caller frees it.
+ */
+size_t *sortOrder(const Student *students, size_t numStudents, const SortSpec *spec) {
+    uint64_t start = PERF_START();
+    size_t width = 0;
+    for (size_t k = 0; k < spec->count; k++) {
+        width += keyWidth(spec->keys[k].column);
+    }
+    size_t rowWidth = width < 8 ? 8 : width;
+
+    size_t *order = malloc((numStudents + 1) * sizeof(size_t));
+    unsigned char *keys = calloc(numStudents + 1, rowWidth);
+    SortEntry *entries = malloc((numStudents + 1) * sizeof(SortEntry));
+    SortEntry *scratch = malloc((numStudents + 1) * sizeof(SortEntry));
+    if (order == NULL || keys == NULL || entries == NULL || scratch == NULL) {
+        perror("Error allocating memory for sort keys");
+        free(order);
+        free(keys);
+        free(entries);
+        free(scratch);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < numStudents; i++) {
+        unsigned char *key = keys + i * rowWidth;
+        unsigned char *slot = key;
+        for (size_t k = 0; k < spec->count; k++) {
+            packKey(&students[i], &spec->keys[k], slot);
+            slot += keyWidth(spec->keys[k].column);
+        }
+        entries[i].prefix = collationPrefix((const char *)key);
+        entries[i].key = key;
+        entries[i].index = i;
+    }
+
+    mergeSortEntries(entries, scratch, numStudents, rowWidth - 8);
+
+    for (size_t i = 0; i < numStudents; i++) {
+        order[i] = entries[i].index;
+    }
+
+    free(keys);
+    free(entries);
+    free(scratch);
+    PERF_STOP(PERF_SORT_ORDER, start);
+    return order;
+}
+
+/**
+ * Checks whether one ranked student is worse than another.
+ *
+ * @param a The first ranked student.
+ * @param b The second ranked student.
+ * @return 1 if a has the lower total, or the same total and a later row.
+ */
+static int isWorse(const RankedStudent *a, const RankedStudent *b) {
+    return a->total < b->total || (a->total == b->total && a->index > b->index);
+}
+
+/**
+ * Restores the heap order below a slot of a worst-first heap.
+ *
+ * @param heap The heap.
+ * @param size The number of entries in the heap.
+ * @param slot The slot whose entry may be out of place.
+ */
+static void siftDown(RankedStudent *heap, size_t size, size_t slot) {
+    for (;;) {
+        size_t worst = slot;
+        size_t left = 2 * slot + 1;
+        size_t right = left + 1;
+        if (left < size && isWorse(&heap[left], &heap[worst])) {
+            worst = left;
+        }
+        if (right < size && isWorse(&heap[right], &heap[worst])) {
+            worst = right;
+        }
+        if (worst == slot) {
+            return;
+        }
+        RankedStudent swap = heap[slot];
+        heap[slot] = heap[worst];
+        heap[worst] = swap;
+        slot = worst;
+    }
+}
+
+/**
+ * Finds the k students with the highest totals.
+ *
+ * A heap of the best k students seen so far is kept with the worst of them
+ * on top, so each remaining student costs one comparison unless it makes the
+ * cut. This is O(n log k) instead of sorting the whole roster. Equal totals
+ * rank in roster order.
+ *
+ * @param students Pointer to the array of Student structs.
+ * @param numStudents The number of students in the array.
+ * @param k The number of students wanted.
+ * @param indexes Receives up to k student indexes, best first.
+ * @return The number of indexes stored, min(k, numStudents), or 0 if memory
+ *         cannot be allocated.
+ */
+size_t topByTotal(const Student *students, size_t numStudents, size_t k, size_t *indexes) {
+    size_t size = 0;
+    if (k > numStudents) {
+        k = numStudents;
+    }
+    if (k == 0) {
+        return 0;
+    }
+
+    RankedStudent *heap = malloc(k * sizeof(RankedStudent));
+    if (heap == NULL) {
+        perror("Error allocating memory for top students");
+        return 0;
+    }
+
+    for (size_t i = 0; i < numStudents; i++) {
+        RankedStudent candidate = {calculateTotal(students[i]), i};
+        if (size < k) {
+            // Sift the new entry up from the bottom
+            size_t slot = size++;
+            while (slot > 0 && isWorse(&candidate, &heap[(slot - 1) / 2])) {
+                heap[slot] = heap[(slot - 1) / 2];
+                slot = (slot - 1) / 2;
+            }
+            heap[slot] = candidate;
+        } else if (isWorse(&heap[0], &candidate)) {
+            heap[0] = candidate;
+            siftDown(heap, size, 0);
+        }
+    }
+
+    // Repeatedly remove the worst, filling the result from the back
+    for (size_t remaining = size; remaining > 0; remaining--) {
+        indexes[remaining - 1] = heap[0].index;
+        heap[0] = heap[remaining - 1];
+        siftDown(heap, remaining - 1, 0);
+    }
+
+    free(heap);
+    return size;
+}
+
+/**
+ * Parses a sort specification such as "4 2 1" or "-4, +2, 1".
+ *
+ * Columns are given by their menu number, highest priority first, and may be
+ * prefixed with '+' (ascending) or '-' (descending); otherwise the column's
+ * default direction is used. Columns may be separated by spaces or commas.
+ *
+ * @param text The text to parse.
+ * @param spec The specification to fill in; left unchanged on error.
+ * @return 0 if the text is a valid specification, -1 otherwise.
+ */
+int parseSortSpec(const char *text, SortSpec *spec) {
+    SortSpec parsed = {0};
+    const char *p = text;
+
+    while (*p != '\0') {
+        if (isspace((unsigned char)*p) || *p == ',') {
+            p++;
+            continue;
+        }
+
+        int direction = -1;
+        if (*p == '+' || *p == '-') {
+            direction = (*p == '-');
+            p++;
+        }
+        if (!isdigit((unsigned char)*p) || parsed.count == MAX_SORT_KEYS) {
+            return -1;
+        }
+
+        char *end;
+        long column = strtol(p, &end, 10);
+        p = end;
+        if (column < SORT_ID || column > SORT_COLUMN_COUNT) {
+            return -1;
+        }
+
+        SortKey *key = &parsed.keys[parsed.count++];
+        key->column = (SortColumn)column;
+        key->descending = direction == -1 ? defaultDescending(key->column) : direction;
+    }
+
+    if (parsed.count == 0) {
+        return -1;
+    }
+    *spec = parsed;
+    return 0;
+}
+
+/**
+ * Describes a sort specification, e.g. "Total (desc), Last name (asc)".
+ *
+ * @param spec The specification to describe.
+ * @param buffer The buffer that receives the description.
+ * @param bufferSize The size of the buffer.
+ */
+void formatSortSpec(const SortSpec *spec, char *buffer, size_t bufferSize) {
+    size_t length = 0;
+    buffer[0] = '\0';
+
+    for (size_t k = 0; k < spec->count && length < bufferSize; k++) {
+        int written = snprintf(buffer + length, bufferSize - length, "%s%s (%s)",
+                               k == 0 ? "" : ", ",
+                               columnNames[spec->keys[k].column],
+                               spec->keys[k].descending ? "desc" : "asc");
+        if (written < 0) {
+            break;
+        }
+        length += (size_t)written;
+    }
+}
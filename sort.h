@@ -0,0 +1,38 @@
+#ifndef SORT_H
+#define SORT_H
+#include <stddef.h>
+#include "student.h"
+
+#define MAX_SORT_KEYS 4
+
+// Sortable columns, numbered as they appear in the sort column menu
+typedef enum {
+    SORT_ID = 1,
+    SORT_LAST_NAME,
+    SORT_EXAM,
+    SORT_TOTAL,
+    SORT_FIRST_NAME,
+    SORT_ASST1,
+    SORT_ASST2,
+    SORT_ASST3,
+    SORT_MIDTERM
+} SortColumn;
+
+#define SORT_COLUMN_COUNT SORT_MIDTERM
+
+typedef struct {
+    SortColumn column;
+    int descending;
+} SortKey;
+
+// Sort keys in priority order; later keys only break ties of earlier ones
+typedef struct {
+    SortKey keys[MAX_SORT_KEYS];
+    size_t count;
+} SortSpec;
+
+int parseSortSpec(const char *text, SortSpec *spec);
+void formatSortSpec(const SortSpec *spec, char *buffer, size_t bufferSize);
+size_t *sortOrder(const Student *students, size_t numStudents, const SortSpec *spec);
+size_t topByTotal(const Student *students, size_t numStudents, size_t k, size_t *indexes);
+#endif // SORT_H
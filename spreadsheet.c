@@ -3,6 +3,10 @@
 #include "spreadsheet.h"
 #include "data.h"
 #include "student.h"
+#include "roster.h"
+#include "export.h"
+#include "perf.h"
+#include "history.h"
 
 
 /**
@@ -47,18 +51,18 @@ int waitForContinue() {
 /**
  * Validates user input for the spreadsheet menu and performs the corresponding action.
  *
- * Prompts the user to enter a menu selection and validates the input to ensure it is a valid menu option (1-8).
+ * Prompts the user to enter a menu selection and validates the input to ensure it is a valid menu option (1-15).
  * If the input is invalid, the function will loop until a valid input is entered.
  * The function performs the corresponding action based on the user's selection.
  *
- * @return 1 if the user selects the exit option (8), 0 otherwise.
+ * @return 1 if the user selects the exit option (15), 0 otherwise.
  */
 int validateSelection() {
     int selectionNumber;
     printf("Selection: ");
     scanf("%d", &selectionNumber);
     system("clear");
-    Student* students = readFile();
+    Student* students = loadRoster();
 
     switch (selectionNumber) {
         case 1:
@@ -96,6 +100,44 @@ int validateSelection() {
             waitForContinue();
             return 0;
         case 8:
+            setFilter(students);
+            waitForContinue();
+            return 0;
+        case 9:
+            removeMatchingStudents(students);
+            waitForContinue();
+            return 0;
+        case 10:
+            exportRoster(students);
+            waitForContinue();
+            return 0;
+        case 11:
+            displayPerfStats();
+            waitForContinue();
+            return 0;
+        case 12:
+            undoLastEdit();
+            waitForContinue();
+            return 0;
+        case 13:
+            redoLastEdit();
+            waitForContinue();
+            return 0;
+        case 14:
+            manageTransaction();
+            waitForContinue();
+            return 0;
+        case 15:
+            if (isTransactionOpen()) {
+                char confirm;
+                printf("The open transaction has %zu uncommitted edits that will be lost.\n"
+                       "Exit anyway? (y/n): ", transactionEditCount());
+                scanf(" %c", &confirm);
+                system("clear");
+                if (confirm != 'y' && confirm != 'Y') {
+                    return 0;
+                }
+            }
             printf("Goodbye and thanks for using our spreadsheet app\n"
                     "\n");
             return 1;